@@ -22,14 +22,29 @@
  * Machine learning for high-speed corner detection, E. Rosten and T. Drummond, ECCV 2006
  */
 
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgproc/types_c.h>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "CharClassifier.h"
 
+#ifdef PARALLEL
+#include <omp.h>
+#endif
+
 using namespace std;
 
+/** the length of the feature vector of extractCharFeatures */
+#define CHAR_FEATURE_COUNT 6
+
 namespace cmp
 {
 
@@ -49,6 +64,48 @@ bool CharClassifier::classifyLetter(LetterCandidate& letter, cv::Mat debugImage)
 	return true;
 }
 
+void CharClassifier::classifyBatch(const std::vector<LetterCandidate*>& letters, std::vector<uchar>& accepted)
+{
+	accepted.resize(letters.size());
+	beginPass();
+#ifdef PARALLEL
+#pragma omp parallel for
+#endif
+	for( size_t i = 0; i < letters.size(); i++ )
+		accepted[i] = classifyLetter(*letters[i]);
+	endPass();
+}
+
+void CharClassifier::beginPass()
+{
+#ifdef PARALLEL
+	threadTimes.assign(omp_get_max_threads(), ThreadTime());
+#else
+	threadTimes.assign(1, ThreadTime());
+#endif
+}
+
+void CharClassifier::endPass()
+{
+	for( size_t i = 0; i < threadTimes.size(); i++ )
+		classificationTime += threadTimes[i].time;
+	threadTimes.clear();
+}
+
+void CharClassifier::addClassificationTime(int64 time)
+{
+	if( threadTimes.empty() )
+	{
+		classificationTime += time;
+		return;
+	}
+#ifdef PARALLEL
+	threadTimes[omp_get_thread_num()].time += time;
+#else
+	threadTimes[0].time += time;
+#endif
+}
+
 double CharClassifier::isWord(LetterCandidate& letter, cv::Mat debugImage)
 {
 	return 0;
@@ -96,6 +153,44 @@ bool CharClassifier::extractLineFeatures(LetterCandidate& letter)
 	return true;
 }
 
+bool CharPreClassifier::reject(LetterCandidate& letter)
+{
+	//the mask is in the level pixels, the bounding box in the image pixels
+	float area = letter.area * letter.scaleFactor * letter.scaleFactor;
+	if( area < minArea )
+		return true;
+	int minSide = MIN(letter.mask.cols, letter.mask.rows);
+	int maxSide = MAX(letter.mask.cols, letter.mask.rows);
+	if( maxSide == 0 || minSide / (float) maxSide < minAspectRatio )
+		return true;
+	if( letter.area / (float) (letter.mask.cols * letter.mask.rows) < minFillRatio )
+		return true;
+	if( maxKeypointDensity > 0 && letter.keypointIds.size() * 100.0f / letter.area > maxKeypointDensity )
+		return true;
+	if( letter.getStrokeAreaRatioP() != -1 && letter.getStrokeAreaRatioP() < minStrokeAreaRatio )
+		return true;
+	return false;
+}
+
+void CharPreClassifier::load(std::string& modelFile)
+{
+	std::cout << "Loading CharPreCls Model from: " << modelFile << std::endl;
+	cv::FileStorage fs(modelFile, cv::FileStorage::READ);
+	if( !fs.isOpened() )
+		CV_Error(CV_StsError, "Can not open the pre-classifier model");
+	cv::FileNode node = fs["preClassifier"];
+	if( !node["minArea"].empty() )
+		node["minArea"] >> minArea;
+	if( !node["minAspectRatio"].empty() )
+		node["minAspectRatio"] >> minAspectRatio;
+	if( !node["minFillRatio"].empty() )
+		node["minFillRatio"] >> minFillRatio;
+	if( !node["maxKeypointDensity"].empty() )
+		node["maxKeypointDensity"] >> maxKeypointDensity;
+	if( !node["minStrokeAreaRatio"].empty() )
+		node["minStrokeAreaRatio"] >> minStrokeAreaRatio;
+}
+
 void extractFeatureVect(cv::Mat& maskO, std::vector<float>& featureVector, LetterCandidate& letter)
 {
 	featureVector.reserve(6);
@@ -242,7 +337,7 @@ static void extractCharFeatures(cv::Mat& maskO, cv::Mat& featureVector, LetterCa
 {
 	cv::Mat mask;
 	cv::copyMakeBorder(maskO, mask, 1, 1, 1, 1, cv::BORDER_CONSTANT);
-	featureVector = cv::Mat::zeros(1, 6, CV_32F);
+	featureVector = cv::Mat::zeros(1, CHAR_FEATURE_COUNT, CV_32F);
 	float *pFeatureVector = featureVector.ptr<float>(0);
 
 	if(letter.contours.size() == 0)
@@ -322,12 +417,127 @@ static void extractCharFeatures(cv::Mat& maskO, cv::Mat& featureVector, LetterCa
 	}
 }
 
+/**
+ * The approximation of extractCharFeatures from the shape statistics accumulated during the segmentation
+ *
+ * The perimeter and the hull are approximated, the model is trained on the exact ones,
+ * so the features are used just by the optional first stage (see setShapeRejectProbability)
+ */
+static void extractShapeFeatures(LetterCandidate& letter, cv::Mat& featureVector)
+{
+	const ShapeStats& shape = letter.shape;
+	featureVector = cv::Mat::zeros(1, CHAR_FEATURE_COUNT, CV_32F);
+	float *pFeatureVector = featureVector.ptr<float>(0);
+
+	float perimeter = shape.perimeter;
+	float outerContourArea = shape.area + shape.holesArea;
+	double cHullLength = 0;
+	double convexHullArea = 0;
+	if( shape.hull.size() > 2 )
+	{
+		cHullLength = cv::arcLength(shape.hull, true);
+		convexHullArea = cv::contourArea(shape.hull);
+	}
+	convexHullArea = MAX(convexHullArea, cHullLength);
+
+	*(pFeatureVector++) = letter.getStrokeAreaRatioP() / letter.area;
+	*(pFeatureVector++) = perimeter == 0 ? 0 : shape.area / (perimeter * perimeter);
+	*(pFeatureVector++) = outerContourArea == 0 ? 0 : convexHullArea / outerContourArea;
+	*(pFeatureVector++) = (float) shape.holesArea / (float) letter.area;
+	if( shape.hull.size() > 2 && perimeter != 0 )
+	{
+		*(pFeatureVector++) = cHullLength / perimeter;
+		cv::RotatedRect rotatedRect = cv::minAreaRect(shape.hull);
+		float width = rotatedRect.size.width;
+		float height = rotatedRect.size.height;
+		*(pFeatureVector) = MIN(width, height) / MAX(width, height);
+	}
+	else
+	{
+		*(pFeatureVector++) = 0;
+		*(pFeatureVector) = MIN(shape.bbox.width, shape.bbox.height) / (float) MAX(shape.bbox.width, shape.bbox.height);
+	}
+}
+
 bool CvBoostCharClassifier::classifyLetter(LetterCandidate& letter, cv::Mat debugImag)
 {
 	double probability;
 	bool val = predictProbability(letter, probability, debugImag  );
 	letter.quality = probability;
-	return val || letter.quality > 0.2;
+	return val || letter.quality > MIN_CHAR_QUALITY;
+}
+
+void CvBoostCharClassifier::classifyBatch(const std::vector<LetterCandidate*>& letters, std::vector<uchar>& accepted)
+{
+	accepted.assign(letters.size(), 0);
+	cv::Mat samples, sums;
+
+	//the first stage on the accumulated shape features (see predictProbability)
+	std::vector<uchar> rejected(letters.size(), 0);
+	if( shapeRejectProbability > 0 )
+	{
+		std::vector<size_t> shapeLetters;
+		for( size_t i = 0; i < letters.size(); i++ )
+		{
+			if( letters[i]->featureVector.empty() && letters[i]->shape.valid )
+				shapeLetters.push_back(i);
+		}
+		samples.create((int) shapeLetters.size(), CHAR_FEATURE_COUNT, CV_32F);
+#ifdef PARALLEL
+#pragma omp parallel for
+#endif
+		for( size_t j = 0; j < shapeLetters.size(); j++ )
+		{
+			cv::Mat shapeFeatures;
+			extractShapeFeatures(*letters[shapeLetters[j]], shapeFeatures);
+			shapeFeatures.copyTo(samples.row((int) j));
+		}
+		int64 startTime = cv::getTickCount();
+		predictSums(samples, sums);
+		classificationTime += cv::getTickCount() - startTime;
+		for( size_t j = 0; j < shapeLetters.size(); j++ )
+		{
+			double probability = toProbability(sums.at<float>((int) j));
+			if( probability < shapeRejectProbability )
+			{
+				letters[shapeLetters[j]]->quality = probability;
+				rejected[shapeLetters[j]] = 1;
+			}
+		}
+	}
+
+	std::vector<size_t> featureLetters;
+	for( size_t i = 0; i < letters.size(); i++ )
+	{
+		if( !rejected[i] )
+			featureLetters.push_back(i);
+	}
+	if( featureLetters.empty() )
+		return;
+#ifdef PARALLEL
+#pragma omp parallel for
+#endif
+	for( size_t j = 0; j < featureLetters.size(); j++ )
+	{
+		LetterCandidate& letter = *letters[featureLetters[j]];
+		if( letter.featureVector.empty() )
+			extractCharFeatures(letter.mask, letter.featureVector, letter);
+	}
+	samples.create((int) featureLetters.size(), letters[featureLetters[0]]->featureVector.cols, CV_32F);
+	for( size_t j = 0; j < featureLetters.size(); j++ )
+		letters[featureLetters[j]]->featureVector.copyTo(samples.row((int) j));
+
+	int64 startTime = cv::getTickCount();
+	predictSums(samples, sums);
+	classificationTime += cv::getTickCount() - startTime;
+
+	for( size_t j = 0; j < featureLetters.size(); j++ )
+	{
+		LetterCandidate& letter = *letters[featureLetters[j]];
+		float sum = sums.at<float>((int) j);
+		letter.quality = toProbability(sum);
+		accepted[featureLetters[j]] = isCharacter(sum) || letter.quality > MIN_CHAR_QUALITY;
+	}
 }
 
 double CvBoostCharClassifier::isWord(LetterCandidate& letter, cv::Mat debugImage)
@@ -342,52 +552,754 @@ double CvBoostCharClassifier::isWord(LetterCandidate& letter, cv::Mat debugImage
 	featureVectorMulti.at<float>(0, 6) = letter.keypointIds.size();
 
 	int64 startTime = cv::getTickCount();
-#ifdef OPENCV_24
-	float sum = classifier->predict(featureVectorMulti, cv::Mat(), cv::Range::all(), false, true);
-	double probability = 1.0f / (1.0f + exp (-sum) );
-#else
-
-	float votes = classifier->predict( featureVectorMulti, cv::noArray(), cv::ml::DTrees::PREDICT_SUM | cv::ml::StatModel::RAW_OUTPUT);
-	double probability = (double)1-(double)1/(1+exp(-2*votes));
-#endif
-	classificationTime += cv::getTickCount() - startTime;
+	double probability = toProbability(predictSum(featureVectorMulti));
+	addClassificationTime(cv::getTickCount() - startTime);
 
 	return probability;
 }
 
 bool CvBoostCharClassifier::predictProbability(LetterCandidate& letter, double& probability, cv::Mat debugImag  )
 {
+	if( letter.featureVector.empty() && letter.shape.valid && shapeRejectProbability > 0 )
+	{
+		//the first stage on the accumulated shape features, the contours are traced just for the passed candidates
+		cv::Mat shapeFeatures;
+		extractShapeFeatures(letter, shapeFeatures);
+		int64 startTime = cv::getTickCount();
+		probability = toProbability(predictSum(shapeFeatures));
+		addClassificationTime(cv::getTickCount() - startTime);
+		if( probability < shapeRejectProbability )
+			return false;
+	}
 	if( letter.featureVector.empty() )
 		extractCharFeatures(letter.mask, letter.featureVector, letter);
 	int64 startTime = cv::getTickCount();
+	float sum = predictSum(letter.featureVector);
+	probability = toProbability(sum);
+	int val = isCharacter(sum);
+	addClassificationTime(cv::getTickCount() - startTime);
+
+	return val;
+}
+
+float CvBoostCharClassifier::predictSum(const cv::Mat& featureVector)
+{
+	if( !quantizedClassifier.empty() )
+		return quantizedClassifier.predict(featureVector.ptr<float>(0));
+	if( !flatClassifier.empty() )
+		return flatClassifier.predict(featureVector.ptr<float>(0));
 #ifdef OPENCV_24
-	float sum = classifier->predict(letter.featureVector, cv::Mat(), cv::Range::all(), false, true);
+	return classifier->predict(featureVector, cv::Mat(), cv::Range::all(), false, true);
+#else
+	return classifier->predict( featureVector, cv::noArray(), cv::ml::DTrees::PREDICT_SUM | cv::ml::StatModel::RAW_OUTPUT);
+#endif
+}
 
+void CvBoostCharClassifier::predictSums(const cv::Mat& samples, cv::Mat& sums)
+{
+	if( !quantizedClassifier.empty() )
+	{
+		quantizedClassifier.predict(samples, sums);
+		return;
+	}
+	if( !flatClassifier.empty() )
+	{
+		flatClassifier.predict(samples, sums);
+		return;
+	}
+	sums.create(samples.rows, 1, CV_32F);
+	for( int i = 0; i < samples.rows; i++ )
+		sums.at<float>(i) = predictSum(samples.row(i));
+}
+
+bool CvBoostCharClassifier::isCharacter(float sum)
+{
+#ifdef OPENCV_24
+	if( classifier.empty() )
+		return sum >= 0;
 	int cls_idx = sum >= 0;
 	const int* cmap = classifier->get_data()->cat_map->data.i;
 	const int* cofs = classifier->get_data()->cat_ofs->data.i;
 	const int* vtype = classifier->get_data()->var_type->data.i;
 
-	int val = (float) cmap[cofs[vtype[classifier->get_data()->var_count]] + cls_idx];
-	probability = 1.0f / (1.0f + exp (-sum) );
+	return cmap[cofs[vtype[classifier->get_data()->var_count]] + cls_idx] != 0;
 #else
-	float votes = classifier->predict( letter.featureVector, cv::noArray(), cv::ml::DTrees::PREDICT_SUM | cv::ml::StatModel::RAW_OUTPUT);
-	probability = (double)1-(double)1/(1+exp(-2*votes));
-	int val = probability > 0.5;
+	return toProbability(sum) > 0.5;
 #endif
-	classificationTime += cv::getTickCount() - startTime;
+}
 
-	return val;
+double CvBoostCharClassifier::toProbability(float sum)
+{
+#ifdef OPENCV_24
+	return 1.0f / (1.0f + exp (-sum) );
+#else
+	return (double)1-(double)1/(1+exp(-2*sum));
+#endif
 }
 
+/**
+ * The model loaded from a file, shared by all the classifiers loaded from it
+ */
+struct LoadedCharModel
+{
+#ifdef OPENCV_24
+	cv::Ptr<CvBoost> classifier;
+#else
+	cv::Ptr<cv::ml::Boost> classifier;
+#endif
+	FlatBoost flatClassifier;
+};
+
+/**
+ * The models referenced by some classifier, by the file name as given to load.
+ * The file rewritten on the disk is loaded again once the classifiers of the old one are released.
+ */
+static std::mutex loadedModelsLock;
+static std::map<std::string, std::weak_ptr<const LoadedCharModel> > loadedModels;
+
 void CvBoostCharClassifier::load(std::string& modelFile){
+	std::lock_guard<std::mutex> lock(loadedModelsLock);
+	std::shared_ptr<const LoadedCharModel> shared = loadedModels[modelFile].lock();
+	if( shared )
+	{
+		//the trees are never modified after the load, the classifiers just reference them
+		loadedModel = shared;
+		classifier = shared->classifier;
+		flatClassifier = shared->flatClassifier;
+		return;
+	}
+	//the released models are dropped from the index
+	for( auto it = loadedModels.begin(); it != loadedModels.end(); )
+	{
+		if( it->second.expired() && it->first != modelFile )
+			it = loadedModels.erase(it);
+		else
+			++it;
+	}
+
 	std::cout << "Loading CharCls Model from: " << modelFile << std::endl;
+	if( FlatBoost::isBinary(modelFile) )
+	{
+		//the binary model is evaluated just by the flat trees
+		classifier.release();
+		if( !flatClassifier.loadBinary(modelFile, CHAR_FEATURE_COUNT) )
+			CV_Error(CV_StsError, "Invalid binary char classifier model");
+	}
+	else
+	{
 #ifdef OPENCV_24
-	classifier = new CvBoost();
-	classifier->load(modelFile.c_str(), "classifier");
+		classifier = new CvBoost();
+		classifier->load(modelFile.c_str(), "classifier");
 #else
-	classifier = cv::ml::StatModel::load<cv::ml::Boost>( modelFile.c_str()/*, "classifier" */);
+		classifier = cv::ml::StatModel::load<cv::ml::Boost>( modelFile.c_str()/*, "classifier" */);
+#endif
+
+		flatClassifier = FlatBoost();
+		cv::FileStorage fs(modelFile, cv::FileStorage::READ);
+		cv::FileNode node = fs["classifier"];
+		if( node.empty() )
+			node = fs.getFirstTopLevelNode();
+		if( !flatClassifier.load(node) || !checkFlatClassifier() )
+		{
+			std::cout << "The flat evaluation of " << modelFile << " is not supported, using the OpenCV one" << std::endl;
+			flatClassifier = FlatBoost();
+		}
+	}
+
+	std::shared_ptr<LoadedCharModel> loaded = std::make_shared<LoadedCharModel>();
+	loaded->classifier = classifier;
+	loaded->flatClassifier = flatClassifier;
+	loadedModel = loaded;
+	loadedModels[modelFile] = loadedModel;
+}
+
+int CvBoostCharClassifier::setQuantized(bool enable, const cv::Mat& validationSamples)
+{
+	quantizedClassifier = QuantizedBoost();
+	if( !enable )
+		return 0;
+	QuantizedBoost quantized;
+	if( flatClassifier.empty() || !flatClassifier.quantize(quantized) )
+		return -1;
+	int flips = 0;
+	if( !validationSamples.empty() )
+	{
+		//the decisions of the float model, without the soft cascade
+		cv::Mat samples;
+		validationSamples.convertTo(samples, CV_32F);
+		FlatBoost flat = flatClassifier;
+		flat.setCascade(std::vector<float>(), 1, 0);
+		cv::Mat sums, quantizedSums;
+		flat.predict(samples, sums);
+		quantized.predict(samples, quantizedSums);
+		float maxError = 0;
+		for( int i = 0; i < samples.rows; i++ )
+		{
+			float sum = sums.at<float>(i);
+			float quantizedSum = quantizedSums.at<float>(i);
+			maxError = MAX(maxError, fabs(sum - quantizedSum));
+			bool accepted = isCharacter(sum) || toProbability(sum) > MIN_CHAR_QUALITY;
+			bool quantizedAccepted = isCharacter(quantizedSum) || toProbability(quantizedSum) > MIN_CHAR_QUALITY;
+			if( accepted != quantizedAccepted || isCharacter(sum) != isCharacter(quantizedSum) )
+				flips++;
+		}
+#ifdef VERBOSE
+		std::cout << "Quantized model: " << flips << " decision flips on " << samples.rows << " samples, max sum error: " << maxError << std::endl;
 #endif
+	}
+	quantizedClassifier = quantized;
+	return flips;
+}
+
+void CvBoostCharClassifier::setSoftCascade(bool enable, const cv::Mat& samples, const cv::Mat& labels, double missRate)
+{
+	if( flatClassifier.empty() )
+		return;
+	if( !enable )
+	{
+		flatClassifier.setCascade(std::vector<float>(), 1, 0);
+		return;
+	}
+	//the letter is accepted if sign * sum > minScore
+	float sign = toProbability(1) > toProbability(0) ? 1 : -1;
+	float lo = -50, hi = 50;
+	for( int i = 0; i < 60; i++ )
+	{
+		float mid = (lo + hi) / 2;
+		if( toProbability(sign * mid) > MIN_CHAR_QUALITY )
+			hi = mid;
+		else
+			lo = mid;
+	}
+	float minScore = lo;
+	//the bisection keeps toProbability(sign * lo) <= MIN_CHAR_QUALITY, so lo is a reject score
+	float rejectScore = lo;
+
+	//the exact bound, the remaining trees can not lift the partial sum over minScore
+	size_t ntrees = flatClassifier.size();
+	std::vector<float> trace(ntrees, -FLT_MAX);
+	float rest = 0;
+	for( int t = (int) ntrees - 1; t >= 0; t-- )
+	{
+		trace[t] = minScore - rest;
+		rest += flatClassifier.maxLeaf(t, sign);
+	}
+
+	std::vector<uchar> accepted(samples.rows, 0);
+	if( !samples.empty() )
+	{
+		CV_Assert( samples.type() == CV_32F && samples.rows == (int) labels.total() );
+		cv::Mat labelsF;
+		labels.reshape(1, samples.rows).convertTo(labelsF, CV_32F);
+		cv::Mat scores(samples.rows, (int) ntrees, CV_32F);
+		std::vector<float> positives;
+		for( int i = 0; i < samples.rows; i++ )
+		{
+			float* sc = scores.ptr<float>(i);
+			flatClassifier.partialScores(samples.ptr<float>(i), sign, sc);
+			float sum = sign * sc[ntrees - 1];
+			accepted[i] = isCharacter(sum) || toProbability(sum) > MIN_CHAR_QUALITY;
+		}
+		for( size_t t = 0; t + 1 < ntrees; t++ )
+		{
+			positives.clear();
+			for( int i = 0; i < samples.rows; i++ )
+			{
+				if( accepted[i] && labelsF.at<float>(i) > 0 )
+					positives.push_back(scores.at<float>(i, (int) t));
+			}
+			if( positives.empty() )
+				break;
+			size_t k = MIN((size_t) (missRate * positives.size()), positives.size() - 1);
+			std::nth_element(positives.begin(), positives.begin() + k, positives.end());
+			trace[t] = MAX(trace[t], positives[k]);
+		}
+	}
+	flatClassifier.setCascade(trace, sign, rejectScore);
+
+	if( !samples.empty() )
+	{
+		//the measured trade-off on the calibration set: the recall and the precision of the full and the cascade decisions
+		//and the scoring time of both, the decisions of the cascade are the ones of predict
+		cv::Mat labelsF;
+		labels.reshape(1, samples.rows).convertTo(labelsF, CV_32F);
+		std::vector<float> sc(ntrees);
+		double evaluated = 0;
+		int positives = 0, truePositives = 0, falsePositives = 0, cascadeTruePositives = 0, cascadeFalsePositives = 0;
+		std::vector<float> sums(samples.rows), fullSums(samples.rows);
+		int64 startTime = cv::getTickCount();
+		for( int i = 0; i < samples.rows; i++ )
+			sums[i] = flatClassifier.predict(samples.ptr<float>(i));
+		double cascadeTime = (cv::getTickCount() - startTime) / cv::getTickFrequency();
+		flatClassifier.setCascade(std::vector<float>(), 1, 0);
+		startTime = cv::getTickCount();
+		for( int i = 0; i < samples.rows; i++ )
+			fullSums[i] = flatClassifier.predict(samples.ptr<float>(i));
+		double fullTime = (cv::getTickCount() - startTime) / cv::getTickFrequency();
+		flatClassifier.setCascade(trace, sign, rejectScore);
+		for( int i = 0; i < samples.rows; i++ )
+		{
+			flatClassifier.partialScores(samples.ptr<float>(i), sign, &sc[0]);
+			size_t t = 0;
+			while( t + 1 < ntrees && sc[t] >= trace[t] )
+				t++;
+			evaluated += t + 1;
+			bool fullAccepted = isCharacter(fullSums[i]) || toProbability(fullSums[i]) > MIN_CHAR_QUALITY;
+			bool cascadeAccepted = isCharacter(sums[i]) || toProbability(sums[i]) > MIN_CHAR_QUALITY;
+			bool positive = labelsF.at<float>(i) > 0;
+			positives += positive;
+			truePositives += positive && fullAccepted;
+			falsePositives += !positive && fullAccepted;
+			cascadeTruePositives += positive && cascadeAccepted;
+			cascadeFalsePositives += !positive && cascadeAccepted;
+		}
+		double recall = positives == 0 ? 0 : truePositives / (double) positives;
+		double precision = truePositives + falsePositives == 0 ? 0 : truePositives / (double) (truePositives + falsePositives);
+		double cascadeRecall = positives == 0 ? 0 : cascadeTruePositives / (double) positives;
+		double cascadePrecision = cascadeTruePositives + cascadeFalsePositives == 0 ? 0 : cascadeTruePositives / (double) (cascadeTruePositives + cascadeFalsePositives);
+		std::cout << "Soft cascade: " << evaluated / samples.rows << " of " << ntrees << " trees per sample, "
+				<< "recall " << cascadeRecall << " (full " << recall << "), precision " << cascadePrecision << " (full " << precision << "), "
+				<< "time " << cascadeTime * 1000 << " ms (full " << fullTime * 1000 << " ms) on " << samples.rows << " samples" << std::endl;
+	}
+}
+
+bool CvBoostCharClassifier::saveBinary(const std::string& modelFile)
+{
+	return flatClassifier.save(modelFile);
+}
+
+void CvBoostCharClassifier::loadSoftCascade(const std::string& calibrationFile, double missRate)
+{
+	cv::FileStorage fs(calibrationFile, cv::FileStorage::READ);
+	if( !fs.isOpened() )
+		CV_Error(CV_StsError, "Can not open the soft cascade calibration data");
+	cv::Mat samples, labels;
+	fs["data"] >> samples;
+	fs["responses"] >> labels;
+	samples.convertTo(samples, CV_32F);
+	setSoftCascade(true, samples, labels, missRate);
+}
+
+bool CvBoostCharClassifier::checkFlatClassifier()
+{
+	//the flat trees have to give the same sums as the loaded model
+	cv::RNG rng(0x1234);
+	cv::Mat sample(1, flatClassifier.varCount, CV_32F);
+	FlatBoost flat;
+	std::swap(flat, flatClassifier);
+	bool valid = true;
+	for( int i = 0; i < 256 && valid; i++ )
+	{
+		rng.fill(sample, cv::RNG::UNIFORM, cv::Scalar(0), cv::Scalar(i < 128 ? 1.5 : 50));
+		float sum = predictSum(sample);
+		float flatSum = flat.predict(sample.ptr<float>(0));
+		valid = fabs(sum - flatSum) <= 1e-4 * (1 + fabs(sum));
+	}
+	std::swap(flat, flatClassifier);
+	return valid;
+}
+
+bool FlatBoost::load(const cv::FileNode& model)
+{
+	*this = FlatBoost();
+	cv::FileNode trees = model["trees"];
+	if( model.empty() || trees.empty() )
+		return false;
+	std::shared_ptr<Storage> trained = std::make_shared<Storage>();
+	int maxDepth = 0;
+	int maxVar = 0;
+	std::vector<ParsedNode> tree;
+	for( cv::FileNode::const_iterator it = trees.begin(); it != trees.end(); ++it )
+	{
+		//the 2.4 models keep the nodes in the tree map, 3.x ones write the node sequence directly
+		cv::FileNode treeNodes = (*it).isMap() ? (*it)["nodes"] : *it;
+		tree.clear();
+		for( cv::FileNode::const_iterator nit = treeNodes.begin(); nit != treeNodes.end(); ++nit )
+		{
+			cv::FileNode node = *nit;
+			ParsedNode pn;
+			pn.depth = (int) node["depth"];
+			pn.value = (float) (double) node["value"];
+			pn.var = -1;
+			pn.threshold = 0;
+			pn.inversed = false;
+			cv::FileNode splits = node["splits"];
+			if( !splits.empty() )
+			{
+				//the first split is the primary one, the rest are the surrogates
+				cv::FileNode split = *splits.begin();
+				pn.var = (int) split["var"];
+				if( !split["le"].empty() )
+					pn.threshold = (float) split["le"];
+				else if( !split["gt"].empty() )
+				{
+					pn.threshold = (float) split["gt"];
+					pn.inversed = true;
+				}
+				else
+					return false; //categorical split
+				maxVar = MAX(maxVar, pn.var + 1);
+			}
+			tree.push_back(pn);
+		}
+		if( tree.empty() )
+			return false;
+		size_t pos = 0;
+		trained->roots.push_back(addSubtree(tree, pos, 0, trained->nodes, maxDepth));
+	}
+	if( !model["var_all"].empty() )
+		maxVar = MAX(maxVar, (int) model["var_all"]);
+
+	storage = trained;
+	nodes = trained->nodes.data();
+	roots = trained->roots.data();
+	nodeCount = (int) trained->nodes.size();
+	treeCount = (int) trained->roots.size();
+	depth = maxDepth;
+	varCount = maxVar;
+	return true;
+}
+
+int FlatBoost::addSubtree(const std::vector<ParsedNode>& tree, size_t& pos, int level, std::vector<Node>& nodes, int& depth)
+{
+	const ParsedNode& pn = tree[pos++];
+	int index = (int) nodes.size();
+	Node node;
+	node.var = 0;
+	node.threshold = 0;
+	node.child[0] = node.child[1] = index;
+	node.value = pn.value;
+	nodes.push_back(node);
+	depth = MAX(depth, level);
+	//the nodes are in the pre-order, the pruned splits have no children
+	if( pn.var < 0 || pos >= tree.size() || tree[pos].depth != pn.depth + 1 )
+		return index;
+
+	int left = addSubtree(tree, pos, level + 1, nodes, depth);
+	int right = index;
+	if( pos < tree.size() && tree[pos].depth == pn.depth + 1 )
+		right = addSubtree(tree, pos, level + 1, nodes, depth);
+	Node& split = nodes[index];
+	split.var = pn.var;
+	split.threshold = pn.threshold;
+	//the sample goes left if (value <= threshold) != inversed
+	split.child[0] = pn.inversed ? right : left;
+	split.child[1] = pn.inversed ? left : right;
+	return index;
+}
+
+bool FlatBoost::quantize(QuantizedBoost& quantized) const
+{
+	quantized = QuantizedBoost();
+	if( empty() || nodeCount > SHRT_MAX || varCount > SHRT_MAX )
+		return false;
+	quantized.varCount = varCount;
+	quantized.depth = depth;
+	quantized.thresholds.resize(varCount);
+	float maxValue = 0;
+	for( int i = 0; i < nodeCount; i++ )
+	{
+		if( nodes[i].child[0] != i )
+			quantized.thresholds[nodes[i].var].push_back(nodes[i].threshold);
+		else
+			maxValue = MAX(maxValue, fabs(nodes[i].value));
+	}
+	for( int v = 0; v < varCount; v++ )
+	{
+		std::vector<float>& thr = quantized.thresholds[v];
+		std::sort(thr.begin(), thr.end());
+		thr.erase(std::unique(thr.begin(), thr.end()), thr.end());
+	}
+	quantized.valueScale = maxValue > 0 ? SHRT_MAX / maxValue : 1;
+
+	quantized.nodes.resize(nodeCount);
+	for( int i = 0; i < nodeCount; i++ )
+	{
+		const Node& node = nodes[i];
+		QuantizedBoost::Node& qnode = quantized.nodes[i];
+		const std::vector<float>& thr = quantized.thresholds[node.var];
+		qnode.var = (short) node.var;
+		qnode.threshold = 0;
+		if( node.child[0] != i )
+			qnode.threshold = (short) (std::lower_bound(thr.begin(), thr.end(), node.threshold) - thr.begin());
+		qnode.child[0] = (short) node.child[0];
+		qnode.child[1] = (short) node.child[1];
+		qnode.value = (short) cvRound(node.value * quantized.valueScale);
+	}
+	for( int t = 0; t < treeCount; t++ )
+		quantized.roots.push_back((short) roots[t]);
+	return true;
+}
+
+void QuantizedBoost::encode(const float* sample, short* encoded) const
+{
+	//the rank is the number of the thresholds below the value
+	for( int v = 0; v < varCount; v++ )
+		encoded[v] = (short) (std::lower_bound(thresholds[v].begin(), thresholds[v].end(), sample[v]) - thresholds[v].begin());
+}
+
+int QuantizedBoost::predict(const short* encoded) const
+{
+	int sum = 0;
+	for( size_t t = 0; t < roots.size(); t++ )
+	{
+		int idx = roots[t];
+		for( int d = 0; d < depth; d++ )
+		{
+			const Node& node = nodes[idx];
+			idx = node.child[encoded[node.var] > node.threshold];
+		}
+		sum += nodes[idx].value;
+	}
+	return sum;
+}
+
+float QuantizedBoost::predict(const float* sample) const
+{
+	cv::AutoBuffer<short> encoded(varCount);
+	encode(sample, encoded);
+	return predict((const short*) encoded) / valueScale;
+}
+
+void QuantizedBoost::predict(const cv::Mat& samples, cv::Mat& sums) const
+{
+	CV_Assert( samples.type() == CV_32F && samples.cols >= varCount );
+	sums.create(samples.rows, 1, CV_32F);
+	cv::Mat encoded(samples.rows, varCount, CV_16S);
+	for( int i = 0; i < samples.rows; i++ )
+		encode(samples.ptr<float>(i), encoded.ptr<short>(i));
+
+	//the samples are processed in blocks, all the trees are walked for the block before the next one
+	const int blockSize = 64;
+	int idx[blockSize];
+	int sum[blockSize];
+	const short* rows[blockSize];
+	for( int b = 0; b < samples.rows; b += blockSize )
+	{
+		int n = MIN(blockSize, samples.rows - b);
+		for( int s = 0; s < n; s++ )
+		{
+			rows[s] = encoded.ptr<short>(b + s);
+			sum[s] = 0;
+		}
+		for( size_t t = 0; t < roots.size(); t++ )
+		{
+			for( int s = 0; s < n; s++ )
+				idx[s] = roots[t];
+			for( int d = 0; d < depth; d++ )
+			{
+				for( int s = 0; s < n; s++ )
+				{
+					const Node& node = nodes[idx[s]];
+					idx[s] = node.child[rows[s][node.var] > node.threshold];
+				}
+			}
+			for( int s = 0; s < n; s++ )
+				sum[s] += nodes[idx[s]].value;
+		}
+		float* out = sums.ptr<float>(b);
+		for( int s = 0; s < n; s++ )
+			out[s] = sum[s] / valueScale;
+	}
+}
+
+#define FLAT_BOOST_SIGNATURE "FTBOOST"
+#define FLAT_BOOST_VERSION 1
+
+/**
+ * The header of the binary model, followed by treeCount roots (int32) and nodeCount nodes
+ */
+struct FlatBoostHeader
+{
+	char signature[8];
+	int32_t version;
+	int32_t nodeSize;
+	int32_t varCount;
+	int32_t depth;
+	int32_t treeCount;
+	int32_t nodeCount;
+};
+
+bool FlatBoost::isBinary(const std::string& modelFile)
+{
+	std::ifstream is(modelFile.c_str(), std::ios::binary);
+	char signature[8] = {0};
+	is.read(signature, sizeof(signature));
+	return is.good() && memcmp(signature, FLAT_BOOST_SIGNATURE, sizeof(FLAT_BOOST_SIGNATURE)) == 0;
+}
+
+bool FlatBoost::save(const std::string& modelFile) const
+{
+	if( empty() )
+		return false;
+	FlatBoostHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.signature, FLAT_BOOST_SIGNATURE, sizeof(FLAT_BOOST_SIGNATURE));
+	header.version = FLAT_BOOST_VERSION;
+	header.nodeSize = sizeof(Node);
+	header.varCount = varCount;
+	header.depth = depth;
+	header.treeCount = treeCount;
+	header.nodeCount = nodeCount;
+	std::ofstream os(modelFile.c_str(), std::ios::binary);
+	os.write((const char*) &header, sizeof(header));
+	os.write((const char*) roots, treeCount * sizeof(int));
+	os.write((const char*) nodes, nodeCount * sizeof(Node));
+	return os.good();
+}
+
+bool FlatBoost::loadBinary(const std::string& modelFile, int featureCount)
+{
+	*this = FlatBoost();
+	//the models mapped in this process, reused while some model references them
+	static std::mutex mappedLock;
+	static std::map<std::string, std::weak_ptr<const Storage> > mapped;
+
+	std::shared_ptr<const Storage> shared;
+	{
+		std::lock_guard<std::mutex> lock(mappedLock);
+		shared = mapped[modelFile].lock();
+		if( !shared )
+		{
+			std::shared_ptr<Storage> file = std::make_shared<Storage>();
+			file->file = std::make_shared<MappedFile>(modelFile);
+			if( !file->file->isOpened() )
+				return false;
+			shared = file;
+			mapped[modelFile] = shared;
+		}
+	}
+
+	const MappedFile& file = *shared->file;
+	if( file.size() < sizeof(FlatBoostHeader) )
+		return false;
+	const FlatBoostHeader* header = (const FlatBoostHeader*) file.data();
+	if( memcmp(header->signature, FLAT_BOOST_SIGNATURE, sizeof(FLAT_BOOST_SIGNATURE)) != 0 || header->version != FLAT_BOOST_VERSION
+			|| header->nodeSize != (int) sizeof(Node) || header->treeCount <= 0 || header->nodeCount <= 0 )
+		return false;
+	if( file.size() < sizeof(FlatBoostHeader) + header->treeCount * sizeof(int) + header->nodeCount * sizeof(Node) )
+		return false;
+	if( header->varCount <= 0 || header->varCount > featureCount || header->depth < 0 || header->depth > header->nodeCount )
+		return false;
+
+	//the trees are walked without the checks, so the corrupted indices fail the load
+	const int* fileRoots = (const int*) (file.data() + sizeof(FlatBoostHeader));
+	const Node* fileNodes = (const Node*) (fileRoots + header->treeCount);
+	for( int t = 0; t < header->treeCount; t++ )
+	{
+		if( fileRoots[t] < 0 || fileRoots[t] >= header->nodeCount )
+			return false;
+	}
+	for( int i = 0; i < header->nodeCount; i++ )
+	{
+		const Node& node = fileNodes[i];
+		if( node.var < 0 || node.var >= header->varCount
+				|| node.child[0] < 0 || node.child[0] >= header->nodeCount || node.child[1] < 0 || node.child[1] >= header->nodeCount )
+			return false;
+	}
+
+	storage = shared;
+	roots = fileRoots;
+	nodes = fileNodes;
+	treeCount = header->treeCount;
+	nodeCount = header->nodeCount;
+	depth = header->depth;
+	varCount = header->varCount;
+	return true;
+}
+
+float FlatBoost::predict(const float* sample) const
+{
+	if( !trace.empty() )
+	{
+		float score = 0;
+		for( int t = 0; t < treeCount; t++ )
+		{
+			score += sign * predictTree(t, sample);
+			if( score < trace[t] )
+				return sign * MIN(score + rest[t], rejectScore);
+		}
+		return sign * score;
+	}
+	float sum = 0;
+	for( int t = 0; t < treeCount; t++ )
+		sum += predictTree(t, sample);
+	return sum;
+}
+
+void FlatBoost::partialScores(const float* sample, float sign, float* scores) const
+{
+	float score = 0;
+	for( int t = 0; t < treeCount; t++ )
+	{
+		score += sign * predictTree(t, sample);
+		scores[t] = score;
+	}
+}
+
+float FlatBoost::maxLeaf(size_t tree, float sign) const
+{
+	//the nodes of the tree are stored from its root to the root of the next tree
+	size_t end = tree + 1 < (size_t) treeCount ? roots[tree + 1] : nodeCount;
+	float maxValue = -FLT_MAX;
+	for( size_t i = roots[tree]; i < end; i++ )
+	{
+		if( nodes[i].child[0] == (int) i )
+			maxValue = MAX(maxValue, sign * nodes[i].value);
+	}
+	return maxValue;
+}
+
+void FlatBoost::setCascade(const std::vector<float>& trace, float sign, float rejectScore)
+{
+	this->trace = trace;
+	this->sign = sign;
+	this->rejectScore = rejectScore;
+	rest.assign(treeCount, 0);
+	for( int t = treeCount - 2; t >= 0; t-- )
+		rest[t] = rest[t + 1] + maxLeaf(t + 1, sign);
+}
+
+void FlatBoost::predict(const cv::Mat& samples, cv::Mat& sums) const
+{
+	CV_Assert( samples.type() == CV_32F && samples.cols >= varCount );
+	sums.create(samples.rows, 1, CV_32F);
+	if( !trace.empty() )
+	{
+		//the cascade stops each sample at a different tree
+		for( int i = 0; i < samples.rows; i++ )
+			sums.at<float>(i) = predict(samples.ptr<float>(i));
+		return;
+	}
+	//the samples are processed in blocks, all the trees are walked for the block before the next one
+	const int blockSize = 64;
+	int idx[blockSize];
+	const float* rows[blockSize];
+	for( int b = 0; b < samples.rows; b += blockSize )
+	{
+		int n = MIN(blockSize, samples.rows - b);
+		float* sum = sums.ptr<float>(b);
+		for( int s = 0; s < n; s++ )
+		{
+			rows[s] = samples.ptr<float>(b + s);
+			sum[s] = 0;
+		}
+		for( int t = 0; t < treeCount; t++ )
+		{
+			for( int s = 0; s < n; s++ )
+				idx[s] = roots[t];
+			for( int d = 0; d < depth; d++ )
+			{
+				for( int s = 0; s < n; s++ )
+				{
+					const Node& node = nodes[idx[s]];
+					idx[s] = node.child[rows[s][node.var] > node.threshold];
+				}
+			}
+			for( int s = 0; s < n; s++ )
+				sum[s] += nodes[idx[s]].value;
+		}
+	}
 }
 
 } /* namespace cmp */
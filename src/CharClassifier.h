@@ -27,6 +27,12 @@
 #include <opencv2/ml/ml.hpp>
 
 #include "segm/segmentation.h"
+#include "IOUtils.h"
+
+#include <memory>
+
+//the minimal quality of the letter accepted by the boosted classifier
+#define MIN_CHAR_QUALITY 0.2
 
 namespace cmp
 {
@@ -45,6 +51,13 @@ public:
 
 	virtual bool classifyLetter(LetterCandidate& letter, cv::Mat debugImage = cv::Mat());
 
+	/**
+	 * Classifies all the letters at once, the default implementation calls classifyLetter on each letter
+	 *
+	 * @param accepted the classifyLetter results, in the order of letters
+	 */
+	virtual void classifyBatch(const std::vector<LetterCandidate*>& letters, std::vector<uchar>& accepted);
+
 	virtual double isWord(LetterCandidate& letter, cv::Mat debugImage = cv::Mat());
 
 	virtual bool predictProbability(LetterCandidate& letter, double& probability, cv::Mat debugImage  = cv::Mat() ){
@@ -54,14 +67,280 @@ public:
 
 	static bool extractLineFeatures(LetterCandidate& letter);
 
+	/**
+	 * Starts the classification pass of the parallel loop: the threads add their time to their own counters
+	 */
+	void beginPass();
+
+	/**
+	 * Ends the pass, the thread counters are summed to classificationTime
+	 */
+	void endPass();
+
 	int64 classificationTime;
+
+protected:
+
+	/** adds the time to the counter of the calling thread, or to classificationTime outside of a pass */
+	void addClassificationTime(int64 time);
+
+private:
+
+	/** the counter of one thread, padded to its own cache line */
+	struct ThreadTime
+	{
+		int64 time = 0;
+		char padding[64 - sizeof(int64)];
+	};
+
+	std::vector<ThreadTime> threadTimes;
+};
+
+/**
+ * @class cmp::CharPreClassifier
+ *
+ * @brief The first stage of the letter classification cascade
+ *
+ * Decision stumps on the features known before the contour extraction (area, aspect ratio,
+ * fill ratio, keypoint count and stroke area ratio) rejecting the clear background.
+ * The candidate passes if it passes all the stumps, a zero bound disables the stump.
+ */
+class CharPreClassifier
+{
+public:
+
+	CharPreClassifier(){
+
+	}
+
+	CharPreClassifier(const char* modelFile){
+		std::string sname = modelFile;
+		load(sname);
+	}
+
+	/**
+	 * @return true if the letter is a clear non-character
+	 */
+	bool reject(LetterCandidate& letter);
+
+	//loads the stump bounds
+	void load(std::string& modelFile);
+
+	/** the minimal candidate area (in the image pixels) */
+	float minArea = 0;
+	/** the minimal ratio of the shorter and the longer bounding box side */
+	float minAspectRatio = 0.04f;
+	/** the minimal ratio of the component area and the bounding box area */
+	float minFillRatio = 0.05f;
+	/** the maximal number of keypoints per 100 component pixels */
+	float maxKeypointDensity = 0;
+	/** the minimal stroke area ratio */
+	float minStrokeAreaRatio = 0.02f;
 };
 
 void extractFeatureVect(cv::Mat& maskO, std::vector<float>& featureVector, LetterCandidate& letter);
 void extractFeatureVectNoSsp(cv::Mat& maskO, std::vector<float>& featureVector);
 
+class QuantizedBoost;
+
+/**
+ * @class cmp::FlatBoost
+ *
+ * @brief The boosted trees of the cv boost model in a contiguous node array
+ *
+ * Evaluates the ordered splits without the generic tree walking of OpenCV. The leaves point to themselves,
+ * so each tree is walked in the fixed number of steps without the branches on the node type.
+ */
+class FlatBoost
+{
+public:
+
+	/**
+	 * Loads the trees from the boost model node (both the 2.4 and 3.x formats)
+	 *
+	 * @return false if the model has the unsupported (categorical) splits
+	 */
+	bool load(const cv::FileNode& model);
+
+	/**
+	 * Maps the binary model file (see save), the file mapping is shared by all the models loaded from it
+	 *
+	 * @param featureCount the length of the evaluated feature vectors
+	 * @return false if the file is not the binary model, or if a root, a child or a feature index is out of range
+	 */
+	bool loadBinary(const std::string& modelFile, int featureCount);
+
+	/**
+	 * Saves the trees in the binary model format: the header, the tree roots and the nodes, in the host byte order
+	 */
+	bool save(const std::string& modelFile) const;
+
+	/** @return true if the file starts with the binary model signature */
+	static bool isBinary(const std::string& modelFile);
+
+	/**
+	 * Builds the int16 fixed-point version of the trees
+	 *
+	 * @return false if the trees do not fit the int16 node indices
+	 */
+	bool quantize(QuantizedBoost& quantized) const;
+
+	inline bool empty() const
+	{
+		return treeCount == 0;
+	}
+
+	/** @return the raw sum of the tree responses */
+	float predict(const float* sample) const;
+
+	/** computes the raw sums for the samples in the rows of the CV_32F matrix */
+	void predict(const cv::Mat& samples, cv::Mat& sums) const;
+
+	/** the partial scores, scores[t] = sign * (sum of the trees 0..t) */
+	void partialScores(const float* sample, float sign, float* scores) const;
+
+	/** @return the largest sign * value of the leaves of the tree */
+	float maxLeaf(size_t tree, float sign) const;
+
+	/**
+	 * Sets the soft cascade, the evaluation stops after the tree t if sign * (partial sum) < trace[t]
+	 *
+	 * The stopped evaluation returns the partial sum extended by the largest possible sum of the remaining trees,
+	 * clamped to sign * rejectScore, so the stopped sample is always rejected. The empty trace disables the cascade.
+	 *
+	 * @param rejectScore the largest sign * sum of the rejected samples
+	 */
+	void setCascade(const std::vector<float>& trace, float sign, float rejectScore);
+
+	inline size_t size() const
+	{
+		return treeCount;
+	}
+
+	int varCount = 0;
+
+private:
+
+	struct Node
+	{
+		int var;
+		float threshold;
+		/** the child for (sample[var] <= threshold) and (sample[var] > threshold) */
+		int child[2];
+		float value;
+	};
+
+	struct ParsedNode
+	{
+		int depth;
+		float value;
+		int var;
+		float threshold;
+		bool inversed;
+	};
+
+	/** the immutable trees, in memory or in the mapped file */
+	struct Storage
+	{
+		std::vector<Node> nodes;
+		std::vector<int> roots;
+		std::shared_ptr<MappedFile> file;
+	};
+
+	static int addSubtree(const std::vector<ParsedNode>& tree, size_t& pos, int level, std::vector<Node>& nodes, int& depth);
+
+	inline float predictTree(size_t tree, const float* sample) const
+	{
+		int idx = roots[tree];
+		for( int d = 0; d < depth; d++ )
+		{
+			const Node& node = nodes[idx];
+			idx = node.child[sample[node.var] > node.threshold];
+		}
+		return nodes[idx].value;
+	}
+
+	/** the storage of the trees, shared by the copies of the model */
+	std::shared_ptr<const Storage> storage;
+	const Node* nodes = NULL;
+	const int* roots = NULL;
+	int nodeCount = 0;
+	int treeCount = 0;
+	/** the maximal depth of the trees */
+	int depth = 0;
+
+	std::vector<float> trace;
+	/** rest[t] = the largest sign * (sum of the trees after t) */
+	std::vector<float> rest;
+	float sign = 1;
+	float rejectScore = 0;
+};
+
+/**
+ * @class cmp::QuantizedBoost
+ *
+ * @brief The int16 fixed-point version of the flat trees
+ *
+ * The features are encoded to their ranks among the split thresholds of the variable (x > threshold[k] iff rank(x) > k),
+ * so the integer splits give the same decisions as the float ones. The leaf values are scaled to int16,
+ * the sums are accumulated in int32.
+ */
+class QuantizedBoost
+{
+public:
+
+	inline bool empty() const
+	{
+		return roots.empty();
+	}
+
+	/** encodes the float feature vector to the threshold ranks */
+	void encode(const float* sample, short* encoded) const;
+
+	/** @return the raw sum of the encoded sample in the fixed-point units (see valueScale) */
+	int predict(const short* encoded) const;
+
+	/** @return the raw sum of the float sample */
+	float predict(const float* sample) const;
+
+	/** computes the raw sums for the samples in the rows of the CV_32F matrix */
+	void predict(const cv::Mat& samples, cv::Mat& sums) const;
+
+	int varCount = 0;
+	/** the fixed-point units of the leaf values and the sums */
+	float valueScale = 1;
+
+private:
+
+	friend class FlatBoost;
+
+	struct Node
+	{
+		short var;
+		/** the threshold rank, the sample goes to child[1] if its rank is greater */
+		short threshold;
+		short child[2];
+		short value;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<short> roots;
+	/** the sorted split thresholds of each variable */
+	std::vector<std::vector<float> > thresholds;
+	int depth = 0;
+};
+
+struct LoadedCharModel;
+
 /**
+ * @class cmp::CvBoostCharClassifier
  *
+ * @brief The boosted trees character classifier
+ *
+ * The trained trees are immutable after the load and shared: the classifiers loaded from the same file
+ * (and the copies of a classifier) reference one model, so any number of segmenters and threads can use it.
+ * The model is released with the last classifier referencing it.
+ * The classifier instance keeps just its statistics and the soft cascade setting.
  */
 class CvBoostCharClassifier : public CharClassifier
 {
@@ -82,20 +361,100 @@ public:
 
 	virtual bool classifyLetter(LetterCandidate& letter, cv::Mat debugImage = cv::Mat() );
 
+	/**
+	 * Extracts the features of all the letters and scores them as one sample matrix
+	 */
+	virtual void classifyBatch(const std::vector<LetterCandidate*>& letters, std::vector<uchar>& accepted);
+
 	virtual double isWord(LetterCandidate& letter, cv::Mat debugImage = cv::Mat());
 
 	virtual bool predictProbability(LetterCandidate& letter, double& probability, cv::Mat debugImag  = cv::Mat() );
 
-	//loads model file
+	//loads model file, the cv boost model or the binary one (see saveBinary)
 	void load(std::string& modelFile);
 
+	/**
+	 * Saves the model in the binary format, which is memory mapped on load and shared by the classifiers (and processes) using it
+	 *
+	 * @return false if the model can not be flattened
+	 */
+	bool saveBinary(const std::string& modelFile);
+
+	/**
+	 * The candidates with the shape statistics (see PyramidSegmenter::shapeStats) are first scored on the features
+	 * approximated from the statistics and rejected without the contour extraction if their probability is below the threshold.
+	 *
+	 * The model is trained on the exact contour features, the approximated perimeter and hull shift the scores,
+	 * so the first stage is off by default until its accuracy drop is measured on the evaluation set.
+	 *
+	 * @param rejectProbability the rejection threshold, 0 (default) disables the first stage (keep it below MIN_CHAR_QUALITY)
+	 */
+	void setShapeRejectProbability(double rejectProbability){
+		shapeRejectProbability = rejectProbability;
+	}
+
+	/**
+	 * Switches the scoring to the int16 quantized trees (see QuantizedBoost), the quantized scoring does not use the soft cascade
+	 *
+	 * @param validationSamples if not empty, the decisions of the quantized and the float model are compared
+	 * on the samples (rows) and the flips are reported
+	 * @return the number of the decision flips on the validation samples, -1 if the model can not be quantized
+	 */
+	int setQuantized(bool enable, const cv::Mat& validationSamples = cv::Mat());
+
+	/**
+	 * Enables the soft cascade of the flat evaluation (see FlatBoost::setCascade), the cascade is off by default
+	 *
+	 * The scoring stops once the partial sum can not reach MIN_CHAR_QUALITY. The stop traces are tightened
+	 * on the calibration set if given: the trace after each tree is set to the missRate quantile of the partial
+	 * sums of the accepted positive samples, and the recall, the precision and the scoring time of the cascade
+	 * and the full model on the set are reported. Keep it off unless the reported loss is acceptable.
+	 *
+	 * @param samples the calibration feature vectors (rows)
+	 * @param labels the calibration labels, > 0 for the characters
+	 * @param missRate the fraction of the accepted positives the cascade may reject
+	 */
+	void setSoftCascade(bool enable, const cv::Mat& samples = cv::Mat(), const cv::Mat& labels = cv::Mat(), double missRate = 0);
+
+	/**
+	 * Enables the soft cascade calibrated on the data file with the "data" and "responses" matrices
+	 * (as written by the character features training)
+	 */
+	void loadSoftCascade(const std::string& calibrationFile, double missRate);
+
 private:
+
+	/** @return the raw sum of the weak classifiers */
+	float predictSum(const cv::Mat& featureVector);
+
+	/** computes the raw sums of the samples in the matrix rows */
+	void predictSums(const cv::Mat& samples, cv::Mat& sums);
+
+	double toProbability(float sum);
+
+	/** @return true if the raw sum is classified as the character */
+	bool isCharacter(float sum);
+
+	bool checkFlatClassifier();
+
 	// Trained AdaBoost classifier
 #ifdef OPENCV_24
 	cv::Ptr<CvBoost> classifier;
 #else
 	cv::Ptr<cv::ml::Boost> classifier;
 #endif
+
+	/** the flattened trees of the classifier, empty if the model can not be flattened */
+	FlatBoost flatClassifier;
+
+	/** the quantized trees, used for the scoring if not empty */
+	QuantizedBoost quantizedClassifier;
+
+	/** the threshold of the first stage on the approximated shape features, off by default (see setShapeRejectProbability) */
+	double shapeRejectProbability = 0;
+
+	/** the shared model of the file, keeps it loaded */
+	std::shared_ptr<const LoadedCharModel> loadedModel;
 };
 
 } /* namespace cmp */
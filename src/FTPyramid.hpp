@@ -54,6 +54,18 @@ public:
     	CV_Assert( mask.empty() || (mask.type() == CV_8UC1 && mask.size() == image.size()) );
 
     	detectImpl( image, keypoints, keypointsPixels, mask );
+
+    	if( crossScaleRadius > 0 )
+    		KeyPointsFilterC::suppressCrossScale( keypoints, keypointsPixels, scales, scaleFactor, crossScaleRadius );
+    }
+
+    /**
+     * enables the suppression of keypoints duplicated on the neighbouring levels
+     *
+     * @param radius the suppression radius in the pixels of the coarser level, 0 disables the suppression
+     */
+    void setCrossScaleSuppression(float radius){
+    	crossScaleRadius = radius;
     }
 
     /**
@@ -120,6 +132,8 @@ protected:
     cv::Ptr<FASTextI> fastext;
 
     bool erodeImages;
+
+    float crossScaleRadius = 0;
 };
 
 }//namespace cmp
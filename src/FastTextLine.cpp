@@ -48,9 +48,65 @@ void FTextLine::addLetter(int letterId, std::vector<LetterCandidate>& letterCand
 		bbox |= refR.bbox;
 	regionSet.insert(letterId);
 	duplicates += refR.duplicates.size() + 1;
+	if( geometryValid )
+		addGeometry(refR);
+	minRect.size.width = 0;
 }
 
-cv::Mat FTextLine::getNormalizedMask(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, double scale)
+void FTextLine::addGeometry(LetterCandidate& letter)
+{
+	if( letter.isValid && letter.cHullPoints.size() > 0 )
+	{
+		//the hull of the line is the hull of the letters hulls
+		std::vector<cv::Point> points;
+		points.reserve(hull.size() + letter.cHullPoints.size());
+		points.insert(points.end(), hull.begin(), hull.end());
+		points.insert(points.end(), letter.cHullPoints.begin(), letter.cHullPoints.end());
+		cv::convexHull(points, hull);
+	}
+	cv::Point center = letter.getConvexCentroid();
+	sumX += center.x;
+	sumY += center.y;
+	sumXX += (double) center.x * center.x;
+	sumXY += (double) center.x * center.y;
+	sumYY += (double) center.y * center.y;
+	centroidCount++;
+}
+
+void FTextLine::updateGeometry(std::vector<LetterCandidate>& letterCandidates)
+{
+	if( geometryValid )
+		return;
+	hull.clear();
+	sumX = sumY = sumXX = sumXY = sumYY = 0;
+	centroidCount = 0;
+	for( auto it = regionSet.begin(); it != regionSet.end(); it++ )
+		addGeometry(letterCandidates[*it]);
+	geometryValid = true;
+}
+
+void FTextLine::invalidateGeometry()
+{
+	geometryValid = false;
+	minRect.size.width = 0;
+	minRect.size.height = 0;
+}
+
+cv::Vec4f FTextLine::getCenterLine(std::vector<LetterCandidate>& letterCandidates)
+{
+	updateGeometry(letterCandidates);
+	if( centroidCount == 0 )
+		return cv::Vec4f();
+	double x = sumX / centroidCount;
+	double y = sumY / centroidCount;
+	double dx2 = sumXX / centroidCount - x * x;
+	double dy2 = sumYY / centroidCount - y * y;
+	double dxy = sumXY / centroidCount - x * y;
+	float t = (float) atan2( 2 * dxy, dx2 - dy2 ) / 2;
+	return cv::Vec4f((float) cos(t), (float) sin(t), (float) x, (float) y);
+}
+
+cv::Mat FTextLine::getNormalizationTransform(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, double scale)
 {
 	cv::RotatedRect rr = getMinAreaRect(letterCandidates);
 	rr.center.x *= scale;
@@ -76,7 +132,6 @@ cv::Mat FTextLine::getNormalizedMask(const cv::Mat& image, std::vector<LetterCan
 	if( (extbox.y + extbox.height) >= image.rows )
 		extbox.height = image.rows - extbox.y;
 
-	cv::Mat tmp = image(extbox);
 	cv::Point center = cv::Point(extbox.width / 2, extbox.height / 2);
 	cv::Mat rot_mat = getRotationMatrix2D( cv::Point(extbox.width / 2, extbox.height / 2), rr.angle, 1 );
 
@@ -84,6 +139,13 @@ cv::Mat FTextLine::getNormalizedMask(const cv::Mat& image, std::vector<LetterCan
 	rot_mat.at<double>(1,2) += rext.size.height/2.0 - center.y;
 	//rot_matI.at<double>(0,2) -= rext.size.width/2.0 - center.x;
 	//rot_matI.at<double>(1,2) -= rext.size.height/2.0 - center.y;
+	return rot_mat;
+}
+
+cv::Mat FTextLine::getNormalizedMask(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, double scale)
+{
+	cv::Mat rot_mat = getNormalizationTransform(image, letterCandidates, scale);
+	cv::Mat tmp = image(extbox);
 
 	/// Rotate the warped image
 	cv::warpAffine( tmp, norm_line, rot_mat, rext.size );
@@ -91,11 +153,52 @@ cv::Mat FTextLine::getNormalizedMask(const cv::Mat& image, std::vector<LetterCan
 	return norm_line;
 }
 
+void normalizeLines(const cv::Mat& image, std::vector<FTextLine>& textLines, std::vector<LetterCandidate>& letterCandidates, int height, NormalizedLines& lines, double scale)
+{
+	CV_Assert( height > 0 );
+	lines.height = height;
+	lines.offsets.resize(textLines.size());
+	lines.widths.resize(textLines.size());
+	std::vector<cv::Mat> transforms(textLines.size());
+	int total = 0;
+	for( size_t i = 0; i < textLines.size(); i++ )
+	{
+		FTextLine& line = textLines[i];
+		transforms[i] = line.getNormalizationTransform(image, letterCandidates, scale);
+		int width = 0;
+		if( line.extbox.width > 0 && line.extbox.height > 0 && line.rext.size.height > 0 )
+		{
+			line.ocr_scale = height / line.rext.size.height;
+			transforms[i] *= line.ocr_scale;
+			width = MAX(1, cvRound(line.rext.size.width * line.ocr_scale));
+			cv::invertAffineTransform(transforms[i], line.norm_mat);
+		}
+		lines.offsets[i] = total;
+		lines.widths[i] = width;
+		total += width * height;
+	}
+	//a new buffer for each call, the line headers of the previous calls keep their own
+	lines.buffer = cv::Mat(1, MAX(total, 1), image.type());
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for( int i = 0; i < (int) textLines.size(); i++ )
+	{
+		if( lines.widths[i] == 0 )
+			continue;
+		//the destination is the buffer view, so the line is warped in place
+		cv::Mat dst = lines.line(i);
+		cv::warpAffine( image(textLines[i].extbox), dst, transforms[i], dst.size() );
+		textLines[i].norm_line = dst;
+	}
+}
+
 cv::Mat FTextLine::createDebugImage(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, bool color, bool drawRect)
 {
 
 	cv::Mat tmp = cv::Mat::zeros(image.rows, image.cols, CV_8UC1);
-	for( std::set<int>::iterator it = regionSet.begin(); it != regionSet.end(); it++ )
+	for( IdSet::iterator it = regionSet.begin(); it != regionSet.end(); it++ )
 	{
 		LetterCandidate& ref1 =  letterCandidates[*it];
 
@@ -143,14 +246,7 @@ cv::RotatedRect FTextLine::getMinAreaRect(std::vector<LetterCandidate>& letterCa
 {
 	if( minRect.size.width != 0)
 		return minRect;
-	std::vector<cv::Point> pointsAll;
-	for( auto it = regionSet.begin(); it != regionSet.end(); it++ )
-	{
-		LetterCandidate& ref1 =  letterCandidates[*it];
-		if( !ref1.isValid  )
-			continue;
-		pointsAll.insert(pointsAll.end(), ref1.cHullPoints.begin(), ref1.cHullPoints.end());
-	}
+	updateGeometry(letterCandidates);
 
 #ifdef VERBOSE
 	cv::Mat tmp = img.clone();
@@ -173,7 +269,7 @@ cv::RotatedRect FTextLine::getMinAreaRect(std::vector<LetterCandidate>& letterCa
 	cv::waitKey(0);
 #endif
 
-	minRect = minAreaRect( cv::Mat(pointsAll) );
+	minRect = minAreaRect( cv::Mat(hull) );
 	if(minRect.size.width < minRect.size.height){
 		int swp = minRect.size.width;
 		minRect.size.width = minRect.size.height;
@@ -226,6 +322,7 @@ void FTextLine::splitHullLines(std::vector<LetterCandidate>& letterCandidates)
 		}
 	}
 	this->regionSet = this->validRegSet;
+	invalidateGeometry();
 }
 
 } /* namespace cmp */
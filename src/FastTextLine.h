@@ -65,14 +65,37 @@ public:
 
 	virtual ~FTextLine();
 
+	/**
+	 * Adds the letter to the line, the line hull and the centroid moments are updated incrementally
+	 */
 	void addLetter(int letterId, std::vector<LetterCandidate>& letterCandidates);
 
 	cv::Mat createDebugImage(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, bool color, bool drawRect = false);
 
 	cv::Mat getNormalizedMask(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, double scale);
 
+	/**
+	 * Sets the rext and extbox of the line
+	 *
+	 * @return the 2x3 transformation from the extbox image to the rext sized normalized line
+	 */
+	cv::Mat getNormalizationTransform(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates, double scale);
+
+	/**
+	 * @return the minimal area rectangle of the valid letters hull points, cached until the letters change
+	 */
 	cv::RotatedRect getMinAreaRect(std::vector<LetterCandidate>& letterCandidates);
 
+	/**
+	 * @return the line fitted to the letters centroids, the same as cv::fitLine with CV_DIST_L2
+	 */
+	cv::Vec4f getCenterLine(std::vector<LetterCandidate>& letterCandidates);
+
+	/**
+	 * Drops the cached geometry, it has to be called if the letters are changed other way than by addLetter
+	 */
+	void invalidateGeometry();
+
 	void splitHullLines(std::vector<LetterCandidate>& letterCandidates);
 
 	cv::Rect bbox;
@@ -81,8 +104,8 @@ public:
 
 	double angle = 0;
 
-	std::set<int> regionSet;
-	std::set<int> validRegSet;
+	IdSet regionSet;
+	IdSet validRegSet;
 
 	std::vector<cv::Point2f> centers;
 	std::vector<cv::Point> pointsTop;
@@ -118,8 +141,62 @@ public:
 	int type = 0;
 
 	cv::Mat normImage;
+
+private:
+
+	void addGeometry(LetterCandidate& letter);
+
+	/** recomputes the hull and the moments if they were invalidated */
+	void updateGeometry(std::vector<LetterCandidate>& letterCandidates);
+
+	/** the convex hull of the valid letters hull points */
+	std::vector<cv::Point> hull;
+	/** the moments of the letters centroids */
+	double sumX = 0;
+	double sumY = 0;
+	double sumXX = 0;
+	double sumXY = 0;
+	double sumYY = 0;
+	int centroidCount = 0;
+	/** false if hull and the moments have to be recomputed from regionSet */
+	bool geometryValid = true;
 };
 
+/**
+ * The text lines normalized to the common height, stored in one contiguous buffer
+ *
+ * The line i is a continuous height x widths[i] image starting at the pixel offsets[i] of the buffer.
+ */
+struct NormalizedLines{
+
+	/** the single row buffer of all the lines pixels */
+	cv::Mat buffer;
+	int height = 0;
+	std::vector<int> offsets;
+	std::vector<int> widths;
+
+	/**
+	 * @return the line image, a header of the buffer memory
+	 */
+	inline cv::Mat line(size_t i) const
+	{
+		if( widths[i] == 0 )
+			return cv::Mat();
+		return buffer.colRange(offsets[i], offsets[i] + height * widths[i]).reshape(0, height);
+	}
+};
+
+/**
+ * Normalizes the text lines to the given height, the lines are warped in parallel into one buffer
+ *
+ * The warping is the one of FTextLine::getNormalizedMask scaled by the line ocr_scale, the line rext, extbox and norm_mat are set as by it.
+ * Each call allocates a new buffer: the line norm_line and the lines.line(i) are headers of the buffer of this call,
+ * they share its pixels with each other, but not with the lines of the other calls.
+ *
+ * @param height the height of the normalized lines, has to be positive
+ */
+void normalizeLines(const cv::Mat& image, std::vector<FTextLine>& textLines, std::vector<LetterCandidate>& letterCandidates, int height, NormalizedLines& lines, double scale = 1.0);
+
 } /* namespace cmp */
 
 #endif /* FASTTEXTLINE_H_ */
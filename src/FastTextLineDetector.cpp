@@ -9,12 +9,15 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <unordered_set>
 #include <mutex>
 
 #include "geometry.h"
 #include "HoughTLDetector.h"
+#include "GridTLDetector.h"
 
 using namespace cv;
 
@@ -48,18 +51,48 @@ void FastTextLineDetector::findTextLines(const cv::Mat& image, std::vector<Lette
 			CharClassifier::extractLineFeatures(*kv);
 		}
 		kv->scalePoints();
+		//the centroid is cached before the parallel voting reads it
+		kv->getConvexCentroid();
 	}
 	std::vector<LineGroup> hLines;
-	double letterHeight = MIN(image.rows, image.cols);
-	do{
-		HoughTLDetector houghTlDetector;
-		houghTlDetector.findTextLines(letterCandidates, image, letterHeight, hLines, 0);
-		houghTlDetector.findTextLines(letterCandidates, image, letterHeight, hLines, 1);
-		letterHeight /= 2;
-	}while( letterHeight > 5 );
+	if( grouper == GRID_GROUPER )
+	{
+		//the grid grouper links the neighbours to the right only, so it finds just the (close to) horizontal lines,
+		//the slanted and vertical text needs the Hough grouper
+		GridTLDetector gridTlDetector;
+		gridTlDetector.findTextLines(letterCandidates, image, hLines);
+	}
+	else
+	{
+		std::vector<double> letterHeights;
+		double letterHeight = MIN(image.rows, image.cols);
+		do{
+			letterHeights.push_back(letterHeight);
+			letterHeight /= 2;
+		}while( letterHeight > 5 );
+
+		//the passes of each letter height and keypoints type are independent, the lines are concatenated in the serial order
+		int passCount = letterHeights.size() * 2;
+		std::vector<std::vector<LineGroup> > passLines(passCount);
+#ifdef PARALLEL
+#pragma omp parallel
+#endif
+		{
+			HoughTLDetector houghTlDetector;
+			houghTlDetector.coarseToFine = coarseToFine;
+#ifdef PARALLEL
+#pragma omp for schedule(dynamic)
+#endif
+			for( int i = 0; i < passCount; i++ )
+			{
+				houghTlDetector.findTextLines(letterCandidates, image, letterHeights[i / 2], passLines[i], i % 2);
+			}
+		}
+		for( int i = 0; i < passCount; i++ )
+			hLines.insert(hLines.end(), std::make_move_iterator(passLines[i].begin()), std::make_move_iterator(passLines[i].end()));
+	}
 
-	std::vector<LineGroup> hLinesFinal;
-	hLinesFinal = hLines;
+	std::vector<LineGroup> hLinesFinal = std::move(hLines);
 
 	//hLinesFinal = hLines;
 	std::vector<FTextLine> initialTextLines;
@@ -79,22 +112,51 @@ void FastTextLineDetector::findTextLines(const cv::Mat& image, std::vector<Lette
 		initialTextLines.back().getMinAreaRect(letterCandidates);
 	}
 
+	//the passes of the neighbour letter heights find the same lines, the line covered by a line of more letters
+	//and with all its letters in it is the conflict, the axis aligned rectangles of the horizontal lines
+	//are intersected without the polygon clipping
+	std::vector<cv::RotatedRect> lineRects(initialTextLines.size());
+	for( size_t i = 0; i < initialTextLines.size(); i++ )
+		lineRects[i] = initialTextLines[i].getMinAreaRect(letterCandidates);
+	for( size_t i = 0; i < initialTextLines.size(); i++ )
+	{
+		FTextLine& line = initialTextLines[i];
+		if( line.regionSet.empty() )
+			continue;
+		for( size_t j = 0; j < initialTextLines.size(); j++ )
+		{
+			FTextLine& line2 = initialTextLines[j];
+			if( j == i || !line2.isSegmentable || line2.regionSet.size() < line.regionSet.size() || (line2.regionSet.size() == line.regionSet.size() && j > i) )
+				continue;
+			float area = rotatedRectangleIntersectionArea(lineRects[i], lineRects[j]);
+			if( area < 0.5 * lineRects[i].size.area() )
+				continue;
+			if( std::includes(line2.regionSet.begin(), line2.regionSet.end(), line.regionSet.begin(), line.regionSet.end()) )
+			{
+				line.isSegmentable = false;
+				break;
+			}
+		}
+	}
+
 	for( auto& tl : initialTextLines )
 	{
 		if(!tl.isSegmentable)
 			continue;
-		std::vector<cv::Point> centerLine;
-		centerLine.reserve(tl.regionSet.size());
 		if( tl.regionSet.size() < 3 ) {
 			tl.regionSet.clear();
+			tl.invalidateGeometry();
 			tl.isSegmentable = false;
 			continue;
 		}
+#ifdef VERBOSE
+		std::vector<cv::Point> centerLine;
 		for( auto regId : tl.regionSet ){
 			centerLine.push_back(letterCandidates[regId].getConvexCentroid());
 		}
+#endif
 
-		cv::fitLine(centerLine, tl.centerLine, CV_DIST_L2, 0,0.01,0.01);
+		tl.centerLine = tl.getCenterLine(letterCandidates);
 		tl.splitHullLines(letterCandidates);
 		if( tl.pointsTop.size() > 3 )
 			cv::fitLine(tl.pointsTop, tl.topLine, CV_DIST_L2, 0,0.01,0.01);
@@ -102,7 +164,6 @@ void FastTextLineDetector::findTextLines(const cv::Mat& image, std::vector<Lette
 			cv::fitLine(tl.pointsBottom, tl.bottomLine, CV_DIST_L2, 0,0.01,0.01);
 		double angle2 = atan2(tl.centerLine[1], tl.centerLine[0]);
 		tl.angle = angle2;
-		tl.minRect.size.width = 0;
 		cv::RotatedRect rr = tl.getMinAreaRect(letterCandidates);
 		tl.height  = MIN(rr.size.width, rr.size.height);
 #ifdef VERBOSE
@@ -123,7 +184,7 @@ void FastTextLineDetector::findTextLines(const cv::Mat& image, std::vector<Lette
 	{
 		if(!initialTextLines[i].isSegmentable)
 			continue;
-		textLines.push_back(initialTextLines[i]);
+		textLines.push_back(std::move(initialTextLines[i]));
 	}
 }
 
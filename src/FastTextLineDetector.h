@@ -39,6 +39,19 @@ public:
 
 	int minHeight = 5;
 
+	/** the text line grouping engines */
+	enum Grouper{
+		/** the Hough voting of the letter centers for each letter height */
+		HOUGH_GROUPER = 0,
+		/** the chains of the nearest neighbours in a grid, horizontal lines only, see GridTLDetector */
+		GRID_GROUPER = 1
+	};
+
+	int grouper = HOUGH_GROUPER;
+
+	/** if true, the Hough grouper votes on the coarse angles and refines the found lines, see HoughTLDetector::coarseToFine */
+	bool coarseToFine = false;
+
 };
 
 } /* namespace cmp */
@@ -0,0 +1,163 @@
+/*
+ * GridTLDetector.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#include <cfloat>
+
+#include "GridTLDetector.h"
+
+namespace cmp
+{
+
+/**
+ * @return the height band, floor(log2(height))
+ */
+static inline int heightBand(int height)
+{
+	int band = 0;
+	while( (2 << band) <= height )
+		band++;
+	return band;
+}
+
+void GridTLDetector::findTextLines(std::vector<LetterCandidate>& letterCandidates, const cv::Mat& originalImage, std::vector<LineGroup>& lineGroups)
+{
+	CV_Assert( minHeightRatio > 0 && minHeightRatio <= 1 );
+	for( auto& cell : grid )
+		cell.second.clear();
+	candidates.clear();
+	heights.assign(letterCandidates.size(), 0);
+	leftEnd.resize(letterCandidates.size());
+	rightEnd.resize(letterCandidates.size());
+
+	//the cell of the band is large enough to keep the neighbours search in a few cells
+	for( size_t i = 0; i < letterCandidates.size(); i++ )
+	{
+		LetterCandidate& ref = letterCandidates[i];
+		if( ref.duplicate != -1 || ref.bbox.height < 1 || (!ref.isWord && ref.quality <= minQuality) )
+			continue;
+		if( ref.isWord )
+		{
+			//the word is linked by the ends of its box, its height is the shorter side (as in the Hough voting)
+			heights[i] = MIN(ref.bbox.height, ref.bbox.width);
+			cv::Point center(ref.bbox.x + ref.bbox.width / 2, ref.bbox.y + ref.bbox.height / 2);
+			int halfLength = MAX(0, ref.bbox.width / 2 - heights[i] / 2);
+			leftEnd[i] = cv::Point(center.x - halfLength, center.y);
+			rightEnd[i] = cv::Point(center.x + halfLength, center.y);
+		}
+		else
+		{
+			heights[i] = ref.bbox.height;
+			leftEnd[i] = ref.getConvexCentroid();
+			rightEnd[i] = leftEnd[i];
+		}
+		int band = heightBand(heights[i]);
+		float cellSize = maxDistance * (2 << band);
+		grid[cellKey(band, cvFloor(leftEnd[i].x / cellSize), cvFloor(leftEnd[i].y / cellSize))].push_back(i);
+		candidates.push_back(i);
+	}
+
+	rightLink.assign(letterCandidates.size(), -1);
+	leftLink.assign(letterCandidates.size(), -1);
+	leftDistance.assign(letterCandidates.size(), FLT_MAX);
+	for( size_t k = 0; k < candidates.size(); k++ )
+	{
+		int i = candidates[k];
+		LetterCandidate& ref = letterCandidates[i];
+		cv::Point center = rightEnd[i];
+		int height = heights[i];
+		int best = -1;
+		float bestDistance = FLT_MAX;
+		//the bands of the heights within the minHeightRatio
+		int minBand = heightBand(cvFloor(height * minHeightRatio));
+		int maxBand = heightBand(cvCeil(height / minHeightRatio));
+		for( int band2 = minBand; band2 <= maxBand; band2++ )
+		{
+			float cellSize = maxDistance * (2 << band2);
+			float radius = maxDistance * MAX(height, 2 << band2);
+			int x0 = cvFloor(center.x / cellSize);
+			int x1 = cvFloor((center.x + radius) / cellSize);
+			int y0 = cvFloor((center.y - radius) / cellSize);
+			int y1 = cvFloor((center.y + radius) / cellSize);
+			for( int gy = y0; gy <= y1; gy++ )
+			{
+				for( int gx = x0; gx <= x1; gx++ )
+				{
+					auto cell = grid.find(cellKey(band2, gx, gy));
+					if( cell == grid.end() )
+						continue;
+					for( int j : cell->second )
+					{
+						LetterCandidate& ref2 = letterCandidates[j];
+						if( j == i || ref2.keyPoint.type != ref.keyPoint.type )
+							continue;
+						int height2 = heights[j];
+						int maxHeight = MAX(height, height2);
+						if( MIN(height, height2) / (float) maxHeight < minHeightRatio )
+							continue;
+						cv::Point center2 = leftEnd[j];
+						int dx = center2.x - center.x;
+						int dy = center2.y - center.y;
+						if( dx <= 0 )
+							continue;
+						float distance = sqrtf(dx * dx + dy * dy);
+						if( distance > maxDistance * maxHeight )
+							continue;
+						int offset = MIN(abs(dy), MIN(abs(ref2.bbox.y - ref.bbox.y), abs(ref2.bbox.br().y - ref.bbox.br().y)));
+						if( offset > maxBaselineOffset * maxHeight )
+							continue;
+						if( distance < bestDistance || (distance == bestDistance && j < best) )
+						{
+							bestDistance = distance;
+							best = j;
+						}
+					}
+				}
+			}
+		}
+		rightLink[i] = best;
+		if( best != -1 && (bestDistance < leftDistance[best] || (bestDistance == leftDistance[best] && i < leftLink[best])) )
+		{
+			leftDistance[best] = bestDistance;
+			leftLink[best] = i;
+		}
+	}
+
+	//only the mutual nearest neighbours are linked, so the links form chains
+	for( int i : candidates )
+	{
+		if( rightLink[i] != -1 && leftLink[rightLink[i]] != i )
+			rightLink[i] = -1;
+	}
+
+	for( int i : candidates )
+	{
+		if( leftLink[i] != -1 && rightLink[leftLink[i]] == i )
+			continue;
+		//the word counts as three letters (its vote weight in the Hough grouping)
+		int count = letterCandidates[i].isWord ? 3 : 1;
+		double maxQuality = letterCandidates[i].quality;
+		int last = i;
+		while( rightLink[last] != -1 )
+		{
+			last = rightLink[last];
+			maxQuality = MAX(maxQuality, letterCandidates[last].quality);
+			count += letterCandidates[last].isWord ? 3 : 1;
+		}
+		if( count < minLetters || maxQuality < 0.5 )
+			continue;
+
+		cv::Point first = leftEnd[i];
+		cv::Point end = rightEnd[last];
+		double theta = atan2(end.y - first.y, end.x - first.x) + M_PI_2;
+		double rho = first.x * cos(theta) + first.y * sin(theta);
+		lineGroups.push_back(LineGroup(count, rho, theta, 1));
+		lineGroups.back().type = letterCandidates[i].keyPoint.type;
+		for( int j = i; j != -1; j = rightLink[j] )
+			lineGroups.back().regionIds.insert(j);
+	}
+}
+
+} /* namespace cmp */
@@ -0,0 +1,74 @@
+/*
+ * GridTLDetector.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#ifndef GRIDTLDETECTOR_H_
+#define GRIDTLDETECTOR_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <unordered_map>
+
+#include "HoughTLDetector.h"
+
+namespace cmp
+{
+
+/**
+ * @class cmp::GridTLDetector
+ *
+ * @brief The text line grouping by the neighbour links
+ *
+ * The letter candidates are bucketed to a uniform grid of each height band (log2 of the height),
+ * each letter is linked to its nearest compatible right neighbour (similar height, the same polarity and baseline)
+ * if it is also the nearest left neighbour of it, and the chains of the links are the text lines.
+ * The word candidates are linked by the ends of their boxes.
+ * The cost is linear in the number of candidates. The neighbours are searched just to the right
+ * within maxBaselineOffset, so only the lines close to horizontal are found.
+ */
+class GridTLDetector
+{
+public:
+
+	void findTextLines(std::vector<LetterCandidate>& letterCandidates, const cv::Mat& originalImage, std::vector<LineGroup>& lineGroups);
+
+	/** the maximal distance of the linked centers relative to the letter height */
+	float maxDistance = 2.0f;
+
+	/** the minimal ratio of the linked letters heights, the height bands searched for the neighbours follow from it */
+	float minHeightRatio = 0.5f;
+
+	/** the letters of the lower quality are not linked (as they do not vote in the Hough grouping) */
+	float minQuality = 0.3f;
+
+	/** the maximal vertical offset of the linked top, bottom or center relative to the letter height */
+	float maxBaselineOffset = 0.3f;
+
+	/** the minimal count of the letters in the line, a word counts as three letters */
+	int minLetters = 2;
+
+private:
+
+	inline int64 cellKey(int band, int x, int y) const
+	{
+		return (((int64) band * 65536 + (x & 0xFFFF)) << 16) + (y & 0xFFFF);
+	}
+
+	/** the candidates of the grid cells */
+	std::unordered_map<int64, std::vector<int> > grid;
+
+	std::vector<int> candidates;
+	std::vector<int> rightLink;
+	std::vector<int> leftLink;
+	std::vector<float> leftDistance;
+	/** the heights and the linked ends of the candidates, the ends are the centroid of a letter */
+	std::vector<int> heights;
+	std::vector<cv::Point> leftEnd;
+	std::vector<cv::Point> rightEnd;
+};
+
+} /* namespace cmp */
+
+#endif /* GRIDTLDETECTOR_H_ */
@@ -9,6 +9,9 @@
 #	include <opencv2/contrib/contrib.hpp>
 #endif
 
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 #include <map>
 #include <unordered_map>
 #include <mutex>
@@ -23,11 +26,21 @@ namespace cmp
 
 #define NUM_ANGLE 16
 
+/**
+ * The sparse Hough accumulator of the letter centers
+ *
+ * Only the voted (angle, rho) cells are stored, in a pool indexed by an open addressing hash table.
+ * The pool, the region lists of the cells and the table are kept by reset(), so the accumulator is reused
+ * for all the letter height passes and its cost is proportional to the votes, not to the image size.
+ */
 class LineAccumulator{
 public:
 
-	LineAccumulator(const cv::Mat& img, float rho, float theta)
-{
+	/**
+	 * Prepares the accumulator for the image and rho, theta sampling, the stored votes are dropped
+	 */
+	void reset(const cv::Mat& img, float rho, float theta)
+	{
 		int width = img.cols;
 		int height = img.rows;
 		theta_sampling_step = theta;
@@ -39,11 +52,6 @@ public:
 		float irho = 1 / rho;
 		float irho2 = 1 / (2 * rho2);
 
-		sizes[0] = numangle + 2 * voting_offset;
-		sizes[1] = numrho + 2 * voting_offset;
-		idx2 = sizes[1];
-		acc =  cv::Mat(2, sizes, CV_32SC1, cv::Scalar(0));
-
 		tabSin.resize(numangle + 2);
 		tabCos.resize(numangle + 2);
 		tabSin2.resize(numangle + 2);
@@ -57,37 +65,75 @@ public:
 			tabSin2[i] = (float)(sin((double)ang - M_PI_2) * irho2);
 			tabCos2[i] = (float)(cos((double)ang - M_PI_2) * irho2);
 		}
-}
+
+		for( int i = 0; i < cellCount; i++ )
+			cells[i].regions.clear();
+		cellCount = 0;
+		for( size_t i = 0; i < binnedRegions.size(); i++ )
+			regionSlot[binnedRegions[i]] = -1;
+		binnedRegions.clear();
+		regionBins.clear();
+		std::fill(table.begin(), table.end(), -1);
+		regionsMap.clear();
+		for( auto& entry : duplicateIndex )
+			entry.second.clear();
+		duplicateCellSize = 4 * rho;
+		min_value = 3;
+	}
 
 	void addRegion(cv::Point& center, int regId, std::vector<LetterCandidate>& letterCandidates)
 	{
 		LetterCandidate& ref = letterCandidates[regId];
 
-		//check for duplicate
+		//check for duplicate, in the regions of the zero angle cell
 		int r = cvRound( center.x * tabCos[0] + center.y * tabSin[0] );
 		r += (numrho - 1) / 2;
-		int index =  r;
-		for(auto& rid : regions2d[index] ){
-			LetterCandidate& ref2 = letterCandidates[rid];
-			if( ref2.isWord != ref.isWord )
+		//a region with the IoU over 0.7 has its center closer than 1.43 of the region height to the bbox
+		int y0 = cvFloor((ref.bbox.y - 2 * ref.bbox.height) / duplicateCellSize);
+		int y1 = cvFloor((ref.bbox.y + 3 * ref.bbox.height) / duplicateCellSize);
+		for( int y = y0; y <= y1; y++ )
+		{
+			auto entry = duplicateIndex.find(duplicateKey(r, y));
+			if( entry == duplicateIndex.end() )
 				continue;
-			cv::Rect int_box = ref.bbox & ref2.bbox;
-			cv::Rect or_box = ref.bbox | ref2.bbox;
-			if( int_box.area() / (float) or_box.area() > 0.7 ){
-				return;
+			for(auto& rid : entry->second ){
+				LetterCandidate& ref2 = letterCandidates[rid];
+				if( ref2.isWord != ref.isWord )
+					continue;
+				cv::Rect int_box = ref.bbox & ref2.bbox;
+				cv::Rect or_box = ref.bbox | ref2.bbox;
+				if( int_box.area() / (float) or_box.area() > 0.7 ){
+					return;
+				}
 			}
 		}
 
+		//the rho bins of the region center, used by the voting and by the maxima check
+		if( regId >= (int) regionSlot.size() )
+			regionSlot.resize(MAX(letterCandidates.size(), (size_t) regId + 1), -1);
+		if( regionSlot[regId] == -1 )
+		{
+			regionSlot[regId] = binnedRegions.size();
+			binnedRegions.push_back(regId);
+			for( int n = 0; n < numangle; n++)
+			{
+				int r = cvRound( center.x * tabCos[n] + center.y * tabSin[n] );
+				regionBins.push_back(r + (numrho - 1) / 2);
+			}
+		}
+		const int* bins = &regionBins[regionSlot[regId] * numangle];
 
 		if( ref.isWord){
-			ref.rotatedRect.angle = fabs(ref.rotatedRect.angle);
-			if( ref.rotatedRect.size.width <  ref.rotatedRect.size.height ){
-				ref.rotatedRect.angle += 90;
-				int swp = ref.rotatedRect.size.width;
-				ref.rotatedRect.size.width = ref.rotatedRect.size.height;
-				ref.rotatedRect.size.height = swp;
+			//the rectangle is normalized in a copy, the candidates are shared by the parallel passes
+			cv::RotatedRect rotatedRect = ref.rotatedRect;
+			rotatedRect.angle = fabs(rotatedRect.angle);
+			if( rotatedRect.size.width <  rotatedRect.size.height ){
+				rotatedRect.angle += 90;
+				int swp = rotatedRect.size.width;
+				rotatedRect.size.width = rotatedRect.size.height;
+				rotatedRect.size.height = swp;
 			}
-			float theta =  ref.rotatedRect.angle / 180.0 * M_PI - M_PI_2;
+			float theta =  rotatedRect.angle / 180.0 * M_PI - M_PI_2;
 			while( theta < 0)
 				theta += M_PI;
 			while( theta > M_PI)
@@ -102,73 +148,249 @@ public:
 			center.y = ref.bbox.y + ref.bbox.height / 2;
 			int r = cvRound( center.x * tabCos[n] + center.y * tabSin[n] );
 			r += (numrho - 1) / 2;
-			acc.at<int>(n + voting_offset, r + voting_offset) += this->min_value;
-			int index =  n * idx2 +  r;
-			regions2d[index].insert(regId);
-
-			/*
-            acc.at<int>(n + 1 + voting_offset, r + voting_offset) += this->min_value;
-            index =  (n  + 1)  * idx2 +  r;
-            regions2d[index].insert(regId);
-
-            acc.at<int>(n - 1 + voting_offset, r + voting_offset) += this->min_value;
-            index =  (n  - 1)  * idx2 +  r;
-            regions2d[index].insert(regId);
-			 */
+			Cell& cell = get(n, r);
+			cell.votes += this->min_value;
+			if( addToCell(cell, regId) && n == 0 )
+				addDuplicateIndex(r, center.y, regId);
 			return;
 		}
 
 		for( int n = 0; n < numangle; n++)
 		{
-			int r = cvRound( center.x * tabCos[n] + center.y * tabSin[n] );
-			r += (numrho - 1) / 2;
-			int index =  n * idx2 +  r;
+			Cell& cell = get(n, bins[n]);
 			if( ref.quality > 0.3)
-				acc.at<int>(n + voting_offset, r + voting_offset) += 1;
-			regions2d[index].insert(regId);
+				cell.votes += 1;
+			if( addToCell(cell, regId) && n == 0 )
+				addDuplicateIndex(bins[0], center.y, regId);
 		}
 	}
 
+	/**
+	 * Refines the line of the coarse cell (n, r), the regions of the rho bins the fine angles within the half
+	 * of the coarse step can reach are projected at the fine angles and the most voted rho bin with a region
+	 * of the cell is the line (the bins shifted by the half of the bin are tried too, so the line is not split at a bin border).
+	 * The band of the gathered rho bins grows until the line does not reach its border.
+	 *
+	 * @return true if the line of at least two regions was found, its regions are in refinedRegions (ascending)
+	 */
+	bool refineLine(int n, int r, std::vector<LetterCandidate>& letterCandidates, double& lineTheta, double& lineRho, int& lineWeight)
+	{
+		int steps = MAX(1, fineAngles / numangle);
+		double fineStep = theta_sampling_step / steps;
+		double coarseTheta = n * theta_sampling_step;
+
+		//the fine line through the cell regions drifts over the coarse rho bins along their extent
+		const Cell* cell = find(n, r);
+		float dirX = (float) -sin(coarseTheta), dirY = (float) cos(coarseTheta);
+		float minPos = FLT_MAX, maxPos = -FLT_MAX;
+		for( int rid : cell->regions )
+		{
+			int weight;
+			cv::Point center = votingCenter(letterCandidates[rid], weight);
+			float pos = center.x * dirX + center.y * dirY;
+			minPos = MIN(minPos, pos);
+			maxPos = MAX(maxPos, pos);
+		}
+		int band = cvCeil((maxPos - minPos) * sin(theta_sampling_step / 2) / rho) + 1;
+		int bestWeight, bestBin;
+		double bestTheta;
+		float bestOffset;
+		for( ; ; )
+		{
+			bandRegions.clear();
+			for( int r2 = r - band; r2 <= r + band; r2++ )
+			{
+				const Cell* cell2 = find(n, r2);
+				if( cell2 == NULL )
+					continue;
+				for( int rid : cell2->regions )
+				{
+					BandRegion region;
+					region.id = rid;
+					region.center = votingCenter(letterCandidates[rid], region.weight);
+					region.inCell = r2 == r;
+					bandRegions.push_back(region);
+				}
+			}
+
+			bestWeight = -1;
+			bestBin = 0;
+			bestTheta = coarseTheta;
+			bestOffset = 0;
+			//the angles are tried from the coarse one outwards, so it wins the ties
+			for( int i = 0; i < 2 * (steps + 1); i++ )
+			{
+				int j = i / 2;
+				int k = j % 2 == 0 ? j / 2 : -(j + 1) / 2;
+				if( abs(k) * 2 > steps )
+					continue;
+				double theta = coarseTheta + k * fineStep;
+				float offset = i % 2 == 0 ? 0.0f : 0.5f;
+				projectRegions(theta, offset);
+				//the weights are summed in the histogram of the projected bins, the projections span the band only, so no sort is needed
+				int minBin = INT_MAX, maxBin = INT_MIN;
+				for( size_t p = 0; p < projections.size(); p++ )
+				{
+					minBin = MIN(minBin, projections[p].first);
+					maxBin = MAX(maxBin, projections[p].first);
+				}
+				binWeights.assign(maxBin - minBin + 1, 0);
+				binInCell.assign(maxBin - minBin + 1, 0);
+				for( size_t p = 0; p < projections.size(); p++ )
+				{
+					const BandRegion& region = bandRegions[projections[p].second];
+					binWeights[projections[p].first - minBin] += region.weight;
+					binInCell[projections[p].first - minBin] |= region.inCell;
+				}
+				//the line of the other cell regions is refined from their own cell
+				for( int b = 0; b <= maxBin - minBin; b++ )
+				{
+					if( binInCell[b] && binWeights[b] > bestWeight )
+					{
+						bestWeight = binWeights[b];
+						bestBin = b + minBin;
+						bestTheta = theta;
+						bestOffset = offset;
+					}
+				}
+			}
+
+			refinedRegions.clear();
+			projectRegions(bestTheta, bestOffset);
+			int reach = 0;
+			for( size_t j = 0; j < projections.size(); j++ )
+			{
+				if( projections[j].first != bestBin )
+					continue;
+				const BandRegion& region = bandRegions[j];
+				int r2 = cvRound( region.center.x * tabCos[n] + region.center.y * tabSin[n] ) + (numrho - 1) / 2;
+				reach = MAX(reach, abs(r2 - r));
+				refinedRegions.push_back(region.id);
+			}
+			//the next letter of the line is at most a bin further than its last one
+			if( reach + 2 <= band )
+				break;
+			band = reach + 2;
+		}
+		if( refinedRegions.size() < 2 )
+			return false;
+		std::sort(refinedRegions.begin(), refinedRegions.end());
+		lineTheta = bestTheta;
+		lineRho = (bestBin - bestOffset) * rho;
+		//the fine angles around the zero coarse one are wrapped to [0, pi), the normal flips with the rho sign
+		if( lineTheta < 0 )
+		{
+			lineTheta += M_PI;
+			lineRho = -lineRho;
+		}
+		else if( lineTheta >= M_PI )
+		{
+			lineTheta -= M_PI;
+			lineRho = -lineRho;
+		}
+		lineWeight = bestWeight;
+		return true;
+	}
+
+	/**
+	 * @return the votes of the cell
+	 */
+	inline int votes(int n, int r) const
+	{
+		const Cell* cell = find(n, r);
+		return cell != NULL ? cell->votes : 0;
+	}
+
 	void findMaxima(std::vector<cv::Vec4d>& lines, std::vector<LetterCandidate>& letterCandidates)
 	{
-		std::unordered_multimap<int,int> reg_to_line;
-		std::vector<int> lineIx;
-		for (int x = voting_offset; x < acc.cols - voting_offset; x++)
+		if( refine )
+		{
+			findRefinedMaxima(lines, letterCandidates);
+			return;
+		}
+
+		//the voted cells in the rho major order of the dense accumulator scan
+		std::vector<int>& voted = votedBuffer;
+		voted.clear();
+		for( int i = 0; i < cellCount; i++ )
+		{
+			if( cells[i].votes > 0 )
+				voted.push_back(i);
+		}
+		std::sort(voted.begin(), voted.end(), [&](int a, int b) -> bool {
+			if( cells[a].r != cells[b].r )
+				return cells[a].r < cells[b].r;
+			return cells[a].n < cells[b].n;
+		});
+
+		//the maximal votes over the rho bins of each region, a region line is not a maxima if it is below
+		regionMaxVotes.resize(binnedRegions.size());
+		for( size_t k = 0; k < binnedRegions.size(); k++ )
+		{
+			const int* bins = &regionBins[k * numangle];
+			int maxVotes = 0;
+			for( int n2 = 0; n2 < numangle; n2++)
+				maxVotes = MAX(maxVotes, votes(n2, bins[n2]));
+			regionMaxVotes[k] = maxVotes;
+		}
+
+		//the columns are swept with the neighbour columns merged by the angle
+		size_t prevBegin = 0, prevEnd = 0;
+		for( size_t c = 0; c < voted.size(); )
 		{
-			double min, maxVal;
-			cv::minMaxLoc(acc(cv::Rect(x, 0, 1, acc.rows - 1)), &min, &maxVal);
-			for (int n = voting_offset; n < acc.rows - voting_offset; n++)
+			int x = cells[voted[c]].r;
+			size_t columnBegin = c;
+			size_t columnEnd = c;
+			int maxVal = 0;
+			while( columnEnd < voted.size() && cells[voted[columnEnd]].r == x )
 			{
-				int value = acc.at<int>(n, x);
+				maxVal = MAX(maxVal, cells[voted[columnEnd]].votes);
+				columnEnd++;
+			}
+			if( x < 0 || x >= numrho )
+			{
+				//outside of the rho range, the column only neighbours the first or the last one
+				prevBegin = columnBegin;
+				prevEnd = columnEnd;
+				c = columnEnd;
+				continue;
+			}
+			size_t nextEnd = columnEnd;
+			while( nextEnd < voted.size() && cells[voted[nextEnd]].r == x + 1 )
+				nextEnd++;
+			if( prevBegin == prevEnd || cells[voted[prevBegin]].r != x - 1 )
+				prevBegin = prevEnd = columnBegin;
+			size_t prev = prevBegin, next = columnEnd;
+			for( ; c < columnEnd; c++ )
+			{
+				const Cell& cell = cells[voted[c]];
+				int n = cell.n;
+				int value = cell.votes;
+				while( prev < prevEnd && cells[voted[prev]].n < n )
+					prev++;
+				while( next < nextEnd && cells[voted[next]].n < n )
+					next++;
 				if (value < min_value)
 				{
 					continue;
 				}
 
-				if(value < acc.at<int>(n, x + 1) || value < acc.at<int>(n, x - 1)){
+				int valuePrev = prev < prevEnd && cells[voted[prev]].n == n ? cells[voted[prev]].votes : 0;
+				int valueNext = next < nextEnd && cells[voted[next]].n == n ? cells[voted[next]].votes : 0;
+				if(value < valueNext || value < valuePrev){
 					continue;
 				}
 
-				int sumVal = value + acc.at<int>(n, x - 1) + acc.at<int>(n, x + 1);
+				int sumVal = value + valuePrev + valueNext;
 				if( sumVal < maxVal){
 					continue;
 				}
 
-				int index =  (n - voting_offset) * idx2 +  (x - voting_offset);
 				bool is_maxima = true;
-				for( auto& rid: regions2d[index] ){
-					if(!is_maxima)
+				for( auto& rid: cell.regions ){
+					if( regionMaxVotes[regionSlot[rid]] > sumVal ){
+						is_maxima = false;
 						break;
-					LetterCandidate& ref = letterCandidates[rid];
-					cv::Point center = ref.getConvexCentroid();
-
-					for( int n2 = 0; n2 < numangle; n2++){
-						int r = cvRound( center.x * tabCos[n2] + center.y * tabSin[n2] );
-						r += (numrho - 1) / 2;
-						if( acc.at<int>(n2 + voting_offset , r + voting_offset) > sumVal){
-							is_maxima = false;
-							break;
-						}
 					}
 				}
 
@@ -177,112 +399,370 @@ public:
 				}
 
 
-				//if( (n - voting_offset) != numangle / 2)
+				//if( n != numangle / 2)
 					//    continue;
 
-				//double line_rho23 = ((x - 1) - (numrho - 1)*0.5f) * rho;
-				std::multimap<int, std::pair<float, int> > line_rho2;
-				for( auto& rid: regions2d[index] ){
-					LetterCandidate& ref = letterCandidates[rid];
-					cv::Point center = ref.bbox.tl();
-					float r201 = center.x * tabCos2[n - voting_offset] + center.y * tabSin2[n - voting_offset];
-					center = ref.bbox.br();
-					int r202 = center.x * tabCos2[n - voting_offset] + center.y * tabSin2[n - voting_offset];
-					line_rho2.insert( {MIN(r201, r202), std::pair<int, int>(MAX(r201, r202), rid ) });
+				double lineTheta = n * theta_sampling_step;
+				double line_rho = (x - (numrho - 1)*0.5f) * rho;
+				addLine(lines, cell.regions, lineTheta, line_rho, tabCos2[n], tabSin2[n], value, letterCandidates);
+			}
+			prevBegin = columnBegin;
+			prevEnd = columnEnd;
+		}
+	}
 
-				}
-				if( line_rho2.size() == 1 ){
-					continue;
-				}
+	/**
+	 * Finds the maxima of the coarse to fine voting, the line of each local maxima cell (over the rho bins
+	 * of its angle) is refined and a refined line is a maxima if none of its regions is on a refined line of the greater weight
+	 */
+	void findRefinedMaxima(std::vector<cv::Vec4d>& lines, std::vector<LetterCandidate>& letterCandidates)
+	{
+		int refinedCount = 0;
+		for( int i = 0; i < cellCount; i++ )
+		{
+			if( cells[i].regions.size() < 2 )
+				continue;
+			//the plateau of the equal votes is refined from its first cell
+			int value = cells[i].votes;
+			if( value <= votes(cells[i].n, cells[i].r - 1) || value < votes(cells[i].n, cells[i].r + 1) )
+				continue;
+			double lineTheta, lineRho;
+			int weight;
+			if( !refineLine(cells[i].n, cells[i].r, letterCandidates, lineTheta, lineRho, weight) || weight < min_value )
+				continue;
+			if( refinedCount == (int) refinedLines.size() )
+				refinedLines.push_back(RefinedLine());
+			RefinedLine& line = refinedLines[refinedCount++];
+			line.theta = lineTheta;
+			line.rho = lineRho;
+			line.weight = weight;
+			line.regions = refinedRegions;
+		}
 
-				std::vector<float> spacing;
-				spacing.reserve(line_rho2.size());
-				std::map<int, std::pair<float, int>>::iterator itp = line_rho2.begin();
-				std::map<int, std::pair<float, int>>::iterator itn = itp;
-				itn++;
-				do{
-					spacing.push_back(MAX(0.0f, itn->first - itp->second.first));
-					if( itp->second.first > itn->second.first ){
-						std::map<int, std::pair<float, int>>::iterator itc = itn;
-						while( itc->second.first < itp->second.first){
-							itc->second.first = itp->second.first;
-						}
+		//the maximal weight of the refined lines of each region
+		regionMaxVotes.assign(binnedRegions.size(), 0);
+		for( int i = 0; i < refinedCount; i++ )
+		{
+			for( int rid : refinedLines[i].regions )
+				regionMaxVotes[regionSlot[rid]] = MAX(regionMaxVotes[regionSlot[rid]], refinedLines[i].weight);
+		}
 
-					}
-					itp++;
-					itn++;
-				}while(itn != line_rho2.end());
+		//the maxima by the hash of their regions
+		maximaIndex.clear();
+		for( int i = 0; i < refinedCount; i++ )
+		{
+			const RefinedLine& line = refinedLines[i];
+			bool is_maxima = true;
+			size_t regionsHash = line.regions.size();
+			for( int rid : line.regions )
+			{
+				if( regionMaxVotes[regionSlot[rid]] > line.weight )
+				{
+					is_maxima = false;
+					break;
+				}
+				regionsHash = regionsHash * 31 + (size_t) rid;
+			}
+			if( !is_maxima )
+				continue;
+			//the cells of one slanted line share its refined line
+			auto range = maximaIndex.equal_range(regionsHash);
+			for( auto it = range.first; it != range.second && is_maxima; it++ )
+			{
+				if( refinedLines[it->second].regions == line.regions )
+					is_maxima = false;
+			}
+			if( !is_maxima )
+				continue;
+			maximaIndex.insert(std::make_pair(regionsHash, i));
+			float cos2 = (float)(cos(line.theta - M_PI_2) / rho);
+			float sin2 = (float)(sin(line.theta - M_PI_2) / rho);
+			addLine(lines, line.regions, line.theta, line.rho, cos2, sin2, line.weight, letterCandidates);
+		}
+	}
 
-				if( spacing.size() == 0 )
-					continue;
+	/**
+	 * Adds the line of the regions, split at the gaps of the regions projection along the line (the normal
+	 * of the angle lineTheta - pi/2 is cos2, sin2), the regions of the lines are in regionsMap
+	 */
+	void addLine(std::vector<cv::Vec4d>& lines, const std::vector<int>& members, double lineTheta, double line_rho, float cos2, float sin2, int value, std::vector<LetterCandidate>& letterCandidates)
+	{
+		//double line_rho23 = ((x - 1) - (numrho - 1)*0.5f) * rho;
+		std::multimap<int, std::pair<float, int> > line_rho2;
+		for( auto& rid: members ){
+			LetterCandidate& ref = letterCandidates[rid];
+			cv::Point center = ref.bbox.tl();
+			float r201 = center.x * cos2 + center.y * sin2;
+			center = ref.bbox.br();
+			int r202 = center.x * cos2 + center.y * sin2;
+			line_rho2.insert( {MIN(r201, r202), std::pair<int, int>(MAX(r201, r202), rid ) });
 
-				int r = (x - voting_offset);
-				double line_rho = (r - (numrho - 1)*0.5f) * rho;
-				int lineId = lines.size();
-				lines.push_back(cv::Vec4d(line_rho, (n - voting_offset) * theta_sampling_step, value, lineId));
-				itp = line_rho2.begin();
-				itn = itp;
-				itn++;
-				int s = 0;
-				while( itn != line_rho2.end()  ){
-					regionsMap[lineId].insert(itp->second.second);
-					if( ((spacing[s] > 3.8f ) ) ) {
-						if( regionsMap[lineId].size() >= 2 ) {
-							double maxQuality = 0;
-							for(auto& rid : regionsMap[lineId] )
-								maxQuality = MAX(maxQuality, letterCandidates[rid].quality);
-							if( maxQuality < 0.5 ){
-								regionsMap[lineId].clear();
-							}else{
-								lines.back().val[2] = regionsMap[lineId].size();
-								lineId = lines.size();
-								lines.push_back(cv::Vec4d(line_rho, (n - voting_offset) * theta_sampling_step, value, lineId));
-							}
-						}else{
-							regionsMap[lineId].clear();
-						}
-					}
-					itp++;
-					itn++;
-					s++;
+		}
+		if( line_rho2.size() == 1 ){
+			return;
+		}
+
+		std::vector<float> spacing;
+		spacing.reserve(line_rho2.size());
+		std::map<int, std::pair<float, int>>::iterator itp = line_rho2.begin();
+		std::map<int, std::pair<float, int>>::iterator itn = itp;
+		itn++;
+		do{
+			spacing.push_back(MAX(0.0f, itn->first - itp->second.first));
+			if( itp->second.first > itn->second.first ){
+				std::map<int, std::pair<float, int>>::iterator itc = itn;
+				while( itc->second.first < itp->second.first){
+					itc->second.first = itp->second.first;
 				}
-				if( regionsMap[lineId].size() > 0 ) {
+
+			}
+			itp++;
+			itn++;
+		}while(itn != line_rho2.end());
+
+		if( spacing.size() == 0 )
+			return;
+
+		int lineId = lines.size();
+		lines.push_back(cv::Vec4d(line_rho, lineTheta, value, lineId));
+		itp = line_rho2.begin();
+		itn = itp;
+		itn++;
+		int s = 0;
+		while( itn != line_rho2.end()  ){
+			regionsMap[lineId].insert(itp->second.second);
+			if( ((spacing[s] > 3.8f ) ) ) {
+				if( regionsMap[lineId].size() >= 2 ) {
 					double maxQuality = 0;
 					for(auto& rid : regionsMap[lineId] )
 						maxQuality = MAX(maxQuality, letterCandidates[rid].quality);
 					if( maxQuality < 0.5 ){
 						regionsMap[lineId].clear();
+					}else{
+						lines.back().val[2] = regionsMap[lineId].size();
+						lineId = lines.size();
+						lines.push_back(cv::Vec4d(line_rho, lineTheta, value, lineId));
 					}
-					regionsMap[lineId].insert(itp->second.second);
-					lines.back().val[2] = regionsMap[lineId].size();
+				}else{
+					regionsMap[lineId].clear();
 				}
 			}
+			itp++;
+			itn++;
+			s++;
+		}
+		if( regionsMap[lineId].size() > 0 ) {
+			double maxQuality = 0;
+			for(auto& rid : regionsMap[lineId] )
+				maxQuality = MAX(maxQuality, letterCandidates[rid].quality);
+			if( maxQuality < 0.5 ){
+				regionsMap[lineId].clear();
+			}
+			regionsMap[lineId].insert(itp->second.second);
+			lines.back().val[2] = regionsMap[lineId].size();
 		}
 	}
 
-	cv::Mat acc;
 	std::vector<float> tabSin;
 	std::vector<float> tabCos;
 	std::vector<float> tabSin2;
 	std::vector<float> tabCos2;
 
-	int numrho;
-	float rho;
-	float theta_sampling_step;
-	int numangle;
-	int numangle_2;
-
-	int sizes[3];
-	int idx2;
+	int numrho = 0;
+	float rho = 1;
+	float theta_sampling_step = 1;
+	int numangle = 0;
+	int numangle_2 = 0;
 
 	int min_value = 3;
 
-	int voting_offset = 2;
+	/** if true, the angle of each maxima line is refined on the fine grid of fineAngles bins from its regions */
+	bool refine = false;
+	int fineAngles = 64;
+
+	std::unordered_map<int, IdSet> regionsMap;
+
+private:
+
+	/** the voted cell, the regions are sorted ascending */
+	struct Cell{
+		int n;
+		int r;
+		int votes;
+		std::vector<int> regions;
+	};
+
+	/** the line refined from the regions of a voted cell, the regions are sorted ascending */
+	struct RefinedLine{
+		double theta;
+		double rho;
+		int weight;
+		std::vector<int> regions;
+	};
+
+	static inline unsigned int hash(int n, int r)
+	{
+		return (unsigned int) n * 73856093u ^ (unsigned int) r * 19349663u;
+	}
+
+	inline const Cell* find(int n, int r) const
+	{
+		if( table.empty() )
+			return NULL;
+		size_t mask = table.size() - 1;
+		for( size_t slot = hash(n, r) & mask; table[slot] != -1; slot = (slot + 1) & mask )
+		{
+			const Cell& cell = cells[table[slot]];
+			if( cell.n == n && cell.r == r )
+				return &cell;
+		}
+		return NULL;
+	}
+
+	/**
+	 * @return the cell, a new one without votes is created if not stored yet
+	 */
+	Cell& get(int n, int r)
+	{
+		if( (size_t) (cellCount + 1) * 2 > table.size() )
+			rehash(MAX((size_t) 1024, table.size() * 2));
+		size_t mask = table.size() - 1;
+		size_t slot = hash(n, r) & mask;
+		for( ; table[slot] != -1; slot = (slot + 1) & mask )
+		{
+			Cell& cell = cells[table[slot]];
+			if( cell.n == n && cell.r == r )
+				return cell;
+		}
+		if( cellCount == (int) cells.size() )
+			cells.push_back(Cell());
+		table[slot] = cellCount;
+		Cell& cell = cells[cellCount++];
+		cell.n = n;
+		cell.r = r;
+		cell.votes = 0;
+		cell.regions.clear();
+		return cell;
+	}
+
+	void rehash(size_t size)
+	{
+		table.assign(size, -1);
+		size_t mask = size - 1;
+		for( int i = 0; i < cellCount; i++ )
+		{
+			size_t slot = hash(cells[i].n, cells[i].r) & mask;
+			while( table[slot] != -1 )
+				slot = (slot + 1) & mask;
+			table[slot] = i;
+		}
+	}
+
+	/**
+	 * @return true if the region was not in the cell
+	 */
+	static inline bool addToCell(Cell& cell, int regId)
+	{
+		//the regions are voting in the ascending order, so the insertion is mostly an append
+		if( cell.regions.empty() || cell.regions.back() < regId )
+		{
+			cell.regions.push_back(regId);
+			return true;
+		}
+		std::vector<int>::iterator it = std::lower_bound(cell.regions.begin(), cell.regions.end(), regId);
+		if( *it == regId )
+			return false;
+		cell.regions.insert(it, regId);
+		return true;
+	}
+
+	/**
+	 * Fills projections by the rho bin (shifted by offset of the bin) and the index of each band region at the angle theta
+	 */
+	void projectRegions(double theta, float offset)
+	{
+		float cosTheta = (float)(cos(theta) / rho);
+		float sinTheta = (float)(sin(theta) / rho);
+		projections.clear();
+		for( size_t i = 0; i < bandRegions.size(); i++ )
+		{
+			const cv::Point& center = bandRegions[i].center;
+			projections.push_back(std::pair<int, int>(cvRound(center.x * cosTheta + center.y * sinTheta + offset), (int) i));
+		}
+	}
 
-	std::unordered_map<int, std::set<int> > regionsMap;
-	std::unordered_map<int, std::set<int> > regions2d;
+	/**
+	 * @return the center of the region voting, weight is set to its vote weight
+	 */
+	static inline cv::Point votingCenter(LetterCandidate& ref, int& weight)
+	{
+		if( ref.isWord )
+		{
+			weight = 3;
+			return cv::Point(ref.bbox.x + ref.bbox.width / 2, ref.bbox.y + ref.bbox.height / 2);
+		}
+		weight = ref.quality > 0.3 ? 1 : 0;
+		return ref.getConvexCentroid();
+	}
+
+	static inline int64 duplicateKey(int r, int y)
+	{
+		return (int64) r * 4294967296LL + (unsigned int) y;
+	}
+
+	/**
+	 * Adds the region of the zero angle cell r to the duplicates index, by the y of its center
+	 */
+	inline void addDuplicateIndex(int r, int y, int regId)
+	{
+		duplicateIndex[duplicateKey(r, cvFloor(y / duplicateCellSize))].push_back(regId);
+	}
+
+	/** the cells pool, the first cellCount are in use */
+	std::vector<Cell> cells;
+	int cellCount = 0;
+	/** the open addressing table of the cell indices, -1 is an empty slot */
+	std::vector<int> table;
+	std::vector<int> votedBuffer;
+	/** the index of the region in binnedRegions, -1 if the region has not voted */
+	std::vector<int> regionSlot;
+	std::vector<int> binnedRegions;
+	/** numangle rho bins of each binned region */
+	std::vector<int> regionBins;
+	std::vector<int> regionMaxVotes;
+	/** the regions of the zero angle cells in the vertical tiles, the duplicates are searched in the tiles around the region */
+	std::unordered_map<int64, std::vector<int> > duplicateIndex;
+	float duplicateCellSize = 1;
+	/** the region of the rho band of the refined cell */
+	struct BandRegion{
+		int id;
+		cv::Point center;
+		int weight;
+		/** true if the region is in the refined cell */
+		bool inCell;
+	};
+	std::vector<BandRegion> bandRegions;
+	/** the rho bin and the band index of the projected regions of the refined cell */
+	std::vector<std::pair<int, int> > projections;
+	/** the weight of the projected bins and if a region of the refined cell is in the bin */
+	std::vector<int> binWeights;
+	std::vector<char> binInCell;
+	std::vector<int> refinedRegions;
+	/** the refined lines of the voted cells, the storage is kept between the passes */
+	std::vector<RefinedLine> refinedLines;
+	std::unordered_multimap<size_t, int> maximaIndex;
 };
 
+HoughTLDetector::HoughTLDetector() : accumulator(new LineAccumulator())
+{
+
+}
+
+HoughTLDetector::~HoughTLDetector()
+{
+
+}
+
 
 inline void drawLine(cv::Mat& cdst, double rho, double theta, cv::Scalar color)
 {
@@ -304,7 +784,10 @@ void HoughTLDetector::findTextLines(std::vector<LetterCandidate>& letterCandidat
 #endif
 
 	///LineAccumulator acc(originalImage.rows, originalImage.cols, letterHeight / 2);
-	LineAccumulator acc(originalImage, letterHeight / 2, M_PI / 16);
+	LineAccumulator& acc = *accumulator;
+	acc.reset(originalImage, letterHeight / 2, coarseToFine ? M_PI / coarseAngles : M_PI / NUM_ANGLE);
+	acc.refine = coarseToFine;
+	acc.fineAngles = fineAngles;
 
 #ifdef VERBOSE
 	std::cout << "Letter Height: " << letterHeight << " - " << letterHeight / 2 <<   std::endl;
@@ -384,7 +867,7 @@ void HoughTLDetector::findTextLines(std::vector<LetterCandidate>& letterCandidat
 		drawLine(cdst, rho, theta, cv::Scalar(128, 128, 128));
 #endif
 		lineGroups.push_back(LineGroup( initialLines[i].val[2], rho, theta, 1 ));
-		lineGroups.back().regionIds = acc.regionsMap[initialLines[i].val[3]];
+		lineGroups.back().regionIds = std::move(acc.regionsMap[initialLines[i].val[3]]);
 
 #ifdef VERBOSE
 		for( auto rid :  lineGroups.back().regionIds){
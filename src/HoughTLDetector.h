@@ -16,6 +16,8 @@ namespace cmp
 
 typedef cv::Vec<int, 9> Vec9i;
 
+class LineAccumulator;
+
 struct LineGroup{
 
 	LineGroup(double score, double rho, double theta, double scale) : score(score), rho(rho), theta(theta), scale(scale){
@@ -30,8 +32,8 @@ struct LineGroup{
 
 	float density;
 
-	std::set<int> groupIds;
-	std::set<int> regionIds;
+	IdSet groupIds;
+	IdSet regionIds;
 
 	std::vector<cv::Point> pointsTop;
 	std::vector<cv::Point> pointsBottom;
@@ -64,8 +66,29 @@ class HoughTLDetector
 {
 public:
 
+	HoughTLDetector();
+
+	~HoughTLDetector();
+
+	/**
+	 * Finds the text lines of the letters of the given height, the accumulator storage is reused by the subsequent calls
+	 */
 	void findTextLines(std::vector<LetterCandidate>& letterCandidates, const cv::Mat& originalImage, double letterHeight,  std::vector<LineGroup>& lineGroups, int type);
 
+	/**
+	 * if true, the letters vote in coarseAngles angle bins only and the angle of each found line
+	 * is refined from its regions in the fineAngles bins. The refinement of the maxima cells costs more
+	 * than the voting it saves, it is slower than the 16 angle bins voting (test_hough reports both)
+	 */
+	bool coarseToFine = false;
+
+	int coarseAngles = 4;
+
+	int fineAngles = 64;
+
+private:
+
+	cv::Ptr<LineAccumulator> accumulator;
 };
 
 } /* namespace cmp */
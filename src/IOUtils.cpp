@@ -22,6 +22,8 @@
 #   include <unistd.h>
 //#   include <ext/stdio_filebuf.h>
 #   include <sys/wait.h>
+#   include <sys/mman.h>
+#   include <fcntl.h>
 #	include <sys/stat.h>
 #	include <unistd.h>
 #	define GetCurrentDir getcwd
@@ -568,5 +570,54 @@ void IOUtils::CpFile(const std::string& source, const std::string& dst)
 	dest.close();
 }
 
-}//namespace cmp
+MappedFile::MappedFile(const std::string& fileName) : bytes(NULL), length(0)
+{
+#ifdef _WIN32
+	fileHandle = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	mappingHandle = NULL;
+	if(fileHandle == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER fileSize;
+	if(!::GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+		return;
+	mappingHandle = ::CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mappingHandle == NULL)
+		return;
+	bytes = (const char*) ::MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if(bytes != NULL)
+		length = (size_t) fileSize.QuadPart;
+#else
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0)
+		return;
+	struct stat st;
+	if(fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(addr != MAP_FAILED)
+		{
+			bytes = (const char*) addr;
+			length = st.st_size;
+		}
+	}
+	//the mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+}
 
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if(bytes != NULL)
+		::UnmapViewOfFile(bytes);
+	if(mappingHandle != NULL)
+		::CloseHandle(mappingHandle);
+	if(fileHandle != INVALID_HANDLE_VALUE)
+		::CloseHandle(fileHandle);
+#else
+	if(bytes != NULL)
+		munmap((void*) bytes, length);
+#endif
+}
+
+}//namespace cmp
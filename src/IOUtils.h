@@ -51,4 +51,34 @@ namespace cmp
         static void CpFile( const std::string& source, const std::string& dst );
 	};
 
+	/**
+
+	 @brief	The read-only memory mapped file.
+
+	 The mapped pages are shared by all the mappings of the file, in this and in the other processes.
+
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string& fileName);
+		~MappedFile();
+
+		bool isOpened() const { return bytes != NULL; }
+
+		const char* data() const { return bytes; }
+		size_t size() const { return length; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const char* bytes;
+		size_t length;
+#ifdef _WIN32
+		void* fileHandle;
+		void* mappingHandle;
+#endif
+	};
+
 }
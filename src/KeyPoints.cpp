@@ -148,5 +148,103 @@ void KeyPointsFilterC::runByPixelsMask( std::vector<FastKeyPoint>& keypoints, co
     keypoints.erase(std::remove_if(keypoints.begin(), keypoints.end(), MaskPredicate(mask)), keypoints.end());
 }
 
+struct KeypointCrossScaleOrder
+{
+    KeypointCrossScaleOrder(const std::vector<FastKeyPoint>& _keypoints) : keypoints(_keypoints) {}
+    inline bool operator()(int a, int b) const
+    {
+        if( keypoints[a].response != keypoints[b].response )
+            return keypoints[a].response > keypoints[b].response;
+        if( keypoints[a].octave != keypoints[b].octave )
+            return keypoints[a].octave < keypoints[b].octave;
+        return a < b;
+    }
+    const std::vector<FastKeyPoint>& keypoints;
+};
+
+static inline long long crossScaleCell(int cx, int cy)
+{
+    return ((long long) cy << 32) | (unsigned int) cx;
+}
+
+// removes the keypoints of a stroke which is already represented by a stronger keypoint at the neighbouring scale
+void KeyPointsFilterC::suppressCrossScale( std::vector<FastKeyPoint>& keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointPixels,
+        const std::vector<double>& scales, double scaleFactor, float radius )
+{
+    if( keypoints.empty() || radius <= 0 )
+        return;
+
+    std::vector<int> order(keypoints.size());
+    for( size_t i = 0; i < order.size(); i++ )
+        order[i] = (int) i;
+    std::sort(order.begin(), order.end(), KeypointCrossScaleOrder(keypoints));
+
+    //the kept keypoints of each level, bucketed by the radius in the level pixels
+    std::vector<std::unordered_map<long long, std::vector<int> > > grids(scales.size());
+    std::vector<bool> keep(keypoints.size(), true);
+    double maxRatio = scaleFactor * 1.01;
+    for( size_t i = 0; i < order.size(); i++ )
+    {
+        const FastKeyPoint& kp = keypoints[order[i]];
+        double sb = scales[kp.octave];
+        bool suppressed = false;
+        for( size_t la = 0; la < scales.size() && !suppressed; la++ )
+        {
+            double sa = scales[la];
+            double ratio = MAX(sa, sb) / MIN(sa, sb);
+            if( ratio < 1.0001 || ratio > maxRatio || grids[la].empty() )
+                continue;
+            double r = radius / MIN(sa, sb);
+            double cell = radius / sa;
+            int range = (int) ceil(r / cell);
+            int cx = (int) floor(kp.pt.x / cell);
+            int cy = (int) floor(kp.pt.y / cell);
+            for( int y = cy - range; y <= cy + range && !suppressed; y++ )
+            {
+                for( int x = cx - range; x <= cx + range && !suppressed; x++ )
+                {
+                    std::unordered_map<long long, std::vector<int> >::const_iterator it = grids[la].find(crossScaleCell(x, y));
+                    if( it == grids[la].end() )
+                        continue;
+                    for( int j : it->second )
+                    {
+                        const FastKeyPoint& other = keypoints[j];
+                        if( other.type != kp.type || other.channel != kp.channel )
+                            continue;
+                        float dx = other.pt.x - kp.pt.x;
+                        float dy = other.pt.y - kp.pt.y;
+                        if( dx * dx + dy * dy <= r * r )
+                        {
+                            suppressed = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if( suppressed )
+        {
+            keep[order[i]] = false;
+            continue;
+        }
+        double cell = radius / sb;
+        grids[kp.octave][crossScaleCell((int) floor(kp.pt.x / cell), (int) floor(kp.pt.y / cell))].push_back(order[i]);
+    }
+
+    size_t kept = 0;
+    for( size_t i = 0; i < keypoints.size(); i++ )
+    {
+        if( !keep[i] )
+        {
+            keypointPixels.erase(keypoints[i].class_id);
+            continue;
+        }
+        if( kept != i )
+            keypoints[kept] = keypoints[i];
+        kept++;
+    }
+    keypoints.resize(kept);
+}
+
 } /* namespace cmp */
 
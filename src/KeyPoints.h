@@ -75,6 +75,15 @@ public:
 	static void runByImageBorder( std::vector<FastKeyPoint>& keypoints, cv::Size imageSize, int borderSize );
 
 	static void runByPixelsMask( std::vector<FastKeyPoint>& keypoints, const cv::Mat& mask );
+
+	/**
+	 * Removes the keypoints covered by a stronger keypoint of the same type at the neighbouring pyramid scale
+	 *
+	 * @param scales the pyramid level scales (indexed by the keypoint octave)
+	 * @param radius the suppression radius in the pixels of the coarser level
+	 */
+	static void suppressCrossScale( std::vector<FastKeyPoint>& keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointPixels,
+			const std::vector<double>& scales, double scaleFactor, float radius );
 };
 
 } /* namespace cmp */
@@ -205,6 +205,25 @@ static PyObject* getNormalizedLine_cfunc (PyObject *dummy, PyObject *args)
 	return (PyObject *) out;
 }
 
+static PyObject* getNormalizedLines_cfunc (PyObject *dummy, PyObject *args)
+{
+	PyArrayObject *out=NULL;
+	PyArrayObject *layout=NULL;
+	int height = 32;
+	int instance = 0;
+	if (!PyArg_ParseTuple(args, "|ii", &height, &instance))
+			return NULL;
+	if (height <= 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "The normalized line height has to be positive");
+		return NULL;
+	}
+
+	out =  get_normalized_lines(height, instance, &layout);
+
+	return Py_BuildValue("(NN)", out, layout);
+}
+
 static PyObject* acumulateCharFeatures(PyObject *dummy, PyObject *args)
 {
 	PyObject *arg1=NULL;
@@ -238,6 +257,11 @@ static PyMethodDef FastTextMethods[] = {
 		{"getLastDetectionOrbKeypoints",  getLastOrbKeyPoints_cfunc, METH_VARARGS, "Find ORB keypoints in the image"},
 		{"findTextLines",  find_text_lines_cfunc, METH_VARARGS, "Finds and returns text lines in the image"},
 		{"getNormalizedLine",  getNormalizedLine_cfunc, METH_VARARGS, "Returns the normalized line segmentation"},
+		{"getNormalizedLines",  getNormalizedLines_cfunc, METH_VARARGS, "getNormalizedLines([height=32, instance=0]) -> (lines, layout)\n\n"
+				"Returns all the text lines of the last detection normalized to the given height. "
+				"lines is the uint8 array of all the pixels (N for the gray image, Nx3 for the color one), "
+				"layout is the int32 array of the (offset, width) of each line in pixels: "
+				"the line i is lines[offset:offset + width * height] reshaped to (height, width) in the row order"},
 		{"acummulateCharFeatures",  acumulateCharFeatures, METH_VARARGS, "todo"},
 		{"trainCharFeatures",  trainCharFeatures, METH_NOARGS, "todo"},
 		{NULL, NULL, 0, NULL}        /* Sentinel */
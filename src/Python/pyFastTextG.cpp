@@ -333,30 +333,30 @@ PyArrayObject* get_keypoint_strokes(int keypointId, int instance)
 
 	}
 
-	std::vector<std::vector<cv::Ptr<StrokeDir> > >& strokes = instances[instance].segmenter->keypointStrokes[keypointId];
+	const KeypointStrokes& strokes = instances[instance].segmenter->keypointStrokes;
 	npy_intp size_pts[2];
 	int strokesCount = 0;
-	for( size_t i = 0; i < strokes.size(); i++ )
+	for( size_t i = 0; i < strokes.size(keypointId); i++ )
 	{
-		strokesCount += strokes[i].size();
+		strokesCount += strokes.end(keypointId, i) - strokes.begin(keypointId, i);
 	}
 	size_pts[0] = strokesCount;
 
 	size_pts[1] = 4;
 	PyArrayObject* out = (PyArrayObject *) PyArray_SimpleNew( 2, size_pts, NPY_OBJECT );
 	strokesCount = 0;
-	for( size_t i = 0; i < strokes.size(); i++ )
+	for( size_t i = 0; i < strokes.size(keypointId); i++ )
 	{
-		for( size_t j = 0; j < strokes[i].size(); j++ )
+		for( const StrokeDir* sd = strokes.begin(keypointId, i); sd != strokes.end(keypointId, i); sd++ )
 		{
 			char* ptr = (char*) PyArray_GETPTR2(out, strokesCount, 0);
-			PyArray_SETITEM(out, ptr, PyInt_FromLong(strokes[i][j]->center.x));
+			PyArray_SETITEM(out, ptr, PyInt_FromLong(sd->center.x));
 			ptr = (char*) PyArray_GETPTR2(out, strokesCount, 1);
-			PyArray_SETITEM(out, ptr, PyInt_FromLong(strokes[i][j]->center.y));
+			PyArray_SETITEM(out, ptr, PyInt_FromLong(sd->center.y));
 			ptr = (char*) PyArray_GETPTR2(out, strokesCount, 2);
-			PyArray_SETITEM(out, ptr, PyInt_FromLong(strokes[i][j]->direction.x));
+			PyArray_SETITEM(out, ptr, PyInt_FromLong(sd->direction.x));
 			ptr = (char*) PyArray_GETPTR2(out, strokesCount, 3);
-			PyArray_SETITEM(out, ptr, PyInt_FromLong(strokes[i][j]->direction.y));
+			PyArray_SETITEM(out, ptr, PyInt_FromLong(sd->direction.y));
 			strokesCount++;
 		}
 	}
@@ -687,6 +687,41 @@ PyArrayObject* get_normalized_line(int lineNo, int instance)
 	}
 }
 
+PyArrayObject* get_normalized_lines(int height, int instance, PyArrayObject** layout)
+{
+	cmp::NormalizedLines normalizedLines;
+	cmp::normalizeLines(lastImage, textLines, instances[instance].segmenter->getLetterCandidates(), height, normalizedLines);
+
+	//the pixel offset and width of each line in the buffer
+	npy_intp size_layout[2];
+	size_layout[0] = textLines.size();
+	size_layout[1] = 2;
+	*layout = (PyArrayObject *) PyArray_SimpleNew( 2, size_layout, NPY_INT );
+	for(size_t i = 0; i < textLines.size(); i++)
+	{
+		int* ptr = (int *) PyArray_GETPTR2(*layout, i, 0);
+		*ptr++ = normalizedLines.offsets[i];
+		*ptr++ = normalizedLines.widths[i];
+	}
+
+	//the buffer is shared by the norm_line of the text lines, so the array gets its own copy
+	cv::Mat& buffer = normalizedLines.buffer;
+	PyArrayObject* out;
+	if(buffer.type() == CV_8UC3){
+		npy_intp size_pts[2];
+		size_pts[0] = buffer.cols;
+		size_pts[1] = 3;
+		out = (PyArrayObject *) PyArray_SimpleNew( 2, size_pts, NPY_UINT8 );
+	}else{
+		npy_intp size_pts[1];
+		size_pts[0] = buffer.cols;
+		out = (PyArrayObject *) PyArray_SimpleNew( 1, size_pts, NPY_UINT8 );
+	}
+	cv::Mat outMat(buffer.rows, buffer.cols, buffer.type(), PyArray_DATA(out));
+	buffer.copyTo(outMat);
+	return out;
+}
+
 std::vector<std::vector<float> > featuresChar;
 std::vector<std::vector<float> > featuresMultiChar;
 std::vector<int> labesChar;
@@ -1031,6 +1066,12 @@ void train_character_features(void)
         index++;
     }
 
+	//the calibration data of the soft cascade (see CvBoostCharClassifier::loadSoftCascade)
+	cv::FileStorage fsChar("/tmp/charFeatures.xml", cv::FileStorage::WRITE);
+	fsChar << "responses" << responses;
+	fsChar << "data" << data;
+	fsChar.release();
+
 	cv::FileStorage fs("/tmp/charFeaturesMulti.xml", cv::FileStorage::WRITE);
 	fs << "responses" << responsesMultiChar;
 	fs << "data" << data2;
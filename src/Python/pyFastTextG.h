@@ -38,6 +38,8 @@ PyArrayObject* find_text_lines(const char * outputDir, const char * imageName, i
 
 PyArrayObject* get_normalized_line(int lineNo, int instance);
 
+PyArrayObject* get_normalized_lines(int height, int instance, PyArrayObject** layout);
+
 PyArrayObject* get_keypoint_strokes(int keypointId, int instance);
 
 PyArrayObject* get_last_detection_keypoints();
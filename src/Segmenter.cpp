@@ -22,7 +22,7 @@
  * Machine learning for high-speed corner detection, E. Rosten and T. Drummond, ECCV 2006
  */
 #include <unordered_map>
-#include <stack>
+#include <map>
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -58,8 +58,11 @@ void Segmenter::classifyLetters(std::vector<cmp::FastKeyPoint>& img1_keypoints,
 	letters.reserve(letterCandidates.size());
 	int letterNo = 0;
 
+	std::vector<uchar> rejected(letterCandidates.size(), 0);
+	//the threads sum their own stroke area time, the sums are added after the loop
+	double strokeTime = 0;
 #ifdef PARALLEL
-#pragma omp parallel for
+#pragma omp parallel for reduction(+:strokeTime)
 #endif
 	for (size_t k = 0; k < letterCandidates.size(); k++)
 	{
@@ -67,7 +70,6 @@ void Segmenter::classifyLetters(std::vector<cmp::FastKeyPoint>& img1_keypoints,
 		if(letter->duplicate != -1)
 			continue;
 
-		componentsCount += 1;
 		int64 startTime = cv::getTickCount();
 		if(keypointsPixels.size() > 0)
 		{
@@ -76,27 +78,49 @@ void Segmenter::classifyLetters(std::vector<cmp::FastKeyPoint>& img1_keypoints,
 			letter->quality = letter->getStrokeAreaRatio(img1_keypoints, scales, keypointStrokes);
 		}
 
-		strokeAreaTime += cv::getTickCount() - startTime;
+		strokeTime += cv::getTickCount() - startTime;
 
-		if(!charClassifier.empty())
+		if(!preClassifier.empty() && preClassifier->reject(*letter))
 		{
-			if(charClassifier->classifyLetter(*letter)){
-				double q = letter->quality;
-				if(!wordClassifier.empty() && q > 0.5){
-					letter->isWord = wordClassifier->isWord(*letter) > 0.5;
-					/*
-						if(letter->isWord )
-						{
-							std::cout << "Letter is word with probability: " << letter->quality << std::endl;
-							cv::imshow("multiChar", letter->mask);
-							cv::waitKey(0);
-						}*/
-				}
-			}
+			letter->quality = 0;
+			rejected[k] = 1;
 		}
+	}
+	strokeAreaTime += strokeTime;
 
-		classificationTime += cv::getTickCount() - startTime;
+	//the candidates passing the first stage are classified in one batch
+	std::vector<LetterCandidate*> batch;
+	batch.reserve(letterCandidates.size());
+	for (size_t k = 0; k < letterCandidates.size(); k++)
+	{
+		if(letterCandidates[k].duplicate != -1)
+			continue;
+		componentsCount += 1;
+		if(rejected[k])
+			preRejectedCount++;
+		else
+			batch.push_back(&letterCandidates[k]);
+	}
+
+	if(!charClassifier.empty() && batch.size() > 0)
+	{
+		int64 startTime = cv::getTickCount();
+		std::vector<uchar> accepted;
+		charClassifier->classifyBatch(batch, accepted);
+		if(!wordClassifier.empty())
+		{
+			wordClassifier->beginPass();
 #ifdef PARALLEL
+#pragma omp parallel for
+#endif
+			for (size_t b = 0; b < batch.size(); b++)
+			{
+				if(accepted[b] && batch[b]->quality > 0.5)
+					batch[b]->isWord = wordClassifier->isWord(*batch[b]) > 0.5;
+			}
+			wordClassifier->endPass();
+		}
+		classificationTime += cv::getTickCount() - startTime;
 	}
 
 	for (size_t k = 0; k < letterCandidates.size(); k++)
@@ -104,7 +128,6 @@ void Segmenter::classifyLetters(std::vector<cmp::FastKeyPoint>& img1_keypoints,
 		LetterCandidate* letter = &letterCandidates[k];
 		if(letter->duplicate != -1)
 			continue;
-#endif
 		if(dumpTrainingData)
 		{
 			if( letter->quality > 0.5)
@@ -148,13 +171,43 @@ struct Direction{
 	uchar dirEnd;
 	int mostSame;
 
+	Direction(){
+
+	}
+
 	Direction(uchar dirStart, uchar dirEnd, int mostSame): dirStart(dirStart), dirEnd(dirEnd), mostSame(mostSame){
 
 	}
 };
 
+/**
+ * The fixed capacity list of the directions around the stroke point (there are at most 6 of 12 circle pixels runs)
+ */
+struct Directions{
+
+	Directions(): count(0){
 
-inline void getDirections(long dists[12], int threshold, std::vector<Direction>& directions)
+	}
+
+	inline void push_back(const Direction& dir){
+		assert(count < 12);
+		items[count++] = dir;
+	}
+
+	inline size_t size() const {
+		return count;
+	}
+
+	inline Direction& operator[](size_t i){
+		return items[i];
+	}
+
+	Direction items[12];
+	size_t count;
+};
+
+
+inline void getDirections(long dists[12], int threshold, Directions& directions)
 {
 	int directionStart = 18;
 	int directionEnd = 0;
@@ -309,7 +362,7 @@ static int getIdx12(cv::Point pt)
 }
 
 template<typename _Tp>
-int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKeyPoint& keypoint, double scaleFactor, long (*distFunction)(const _Tp&, const _Tp&), long threshold, int& compCounter, cv::Mat& segmImg, int& area, cv::Rect& roi, std::vector<std::vector<cv::Ptr<StrokeDir> > > & strokes, bool single, int pixel[34], int msLength )
+int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKeyPoint& keypoint, double scaleFactor, long (*distFunction)(const _Tp&, const _Tp&), long threshold, int& compCounter, cv::Mat& segmImg, int& area, cv::Rect& roi, StrokeTrace& strokes, bool single, int pixel[34], int msLength )
 {
 
 	int compNo = ++compCounter;
@@ -333,35 +386,37 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 
 	std::vector<std::vector<cv::Point> > steps;
 	//makeSteps(steps);
-	std::stack<cv::Ptr<StrokeDir> > stack;
-	stack.push(cv::Ptr<StrokeDir> (new StrokeDir(idx, threshold, center, same)));
-	cv::Ptr<StrokeDir> next;
+	std::vector<StrokeDir>& stack = strokes.stack;
+	stack.clear();
+	stack.push_back(StrokeDir(idx, threshold, center, same));
+	StrokeDir next;
+	bool hasNext = false;
 	int strokeLength = 0;
-	while(stack.size() > 0 || !next.empty())
+	while(stack.size() > 0 || hasNext)
 	{
-		cv::Ptr<StrokeDir> current;
-		if( !next.empty() )
+		StrokeDir current;
+		if( hasNext )
 		{
 			current = next;
-			strokes.back().push_back(current);
-			next = cv::Ptr<StrokeDir>();
+			strokes.push(current);
+			hasNext = false;
 			strokeLength++;
 			if( strokeLength > maxStrokeLength || stack.size() > 10 || strokes.size() > 5)
 				return -1;
 		}else{
-			current = stack.top();
-			stack.pop();
+			current = stack.back();
+			stack.pop_back();
 			strokeLength = 0;
-			strokes.push_back(std::vector<cv::Ptr<StrokeDir> >());
-			strokes.back().push_back(current);
+			strokes.beginStroke();
+			strokes.push(current);
 
 		}
-		uchar* ptr = &img.at<_Tp>((int) current->center.y, current->center.x);
+		uchar* ptr = &img.at<_Tp>((int) current.center.y, current.center.x);
 
-		XMin = MIN(XMin, current->center.x);
-		XMax = MAX(XMax, current->center.x);
-		YMin = MIN(YMin, current->center.y);
-		YMax = MAX(YMax, current->center.y);
+		XMin = MIN(XMin, current.center.x);
+		XMax = MAX(XMax, current.center.x);
+		YMin = MIN(YMin, current.center.y);
+		YMax = MAX(YMax, current.center.y);
 
 		for( int k = 0; k < 12; k++ )
 		{
@@ -373,7 +428,7 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 		{
 			repeat = 0;
 			bool updateThreshold = false;
-			std::vector<Direction> directions;
+			Directions directions;
 			getDirections(dists, thresholdc, directions);
 			int dCount = 0;
 			for(size_t j = 0; j < directions.size(); j++)
@@ -396,7 +451,7 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 				if((dir.dirEnd - dir.dirStart) > 3)
 					idx = (dir.dirStart + dir.dirEnd) / 2;
 				idx = idx % 12;
-				cv::Point strokeDir(current->center.x + offsets12[idx][0], current->center.y + offsets12[idx][1]);
+				cv::Point strokeDir(current.center.x + offsets12[idx][0], current.center.y + offsets12[idx][1]);
 				assert(dir.mostSame < 12);
 
 				if(!isMostSameAccessible12(ptr, img.step[0], 1, 0, dir.mostSame % 12, threshold, distFunction))
@@ -412,33 +467,34 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 				}
 				if( idImage.at<int>(strokeDir.y, strokeDir.x) == compNo)
 				{
-					strokes.back().push_back(current);
+					strokes.push(current);
 					repeat = 0;
 					continue;
 				}
-				double dist = cv::norm(strokeDir-current->center);
+				double dist = cv::norm(strokeDir-current.center);
 				if(dist >= 2)
 				{
-					int idxDist = abs(idx - current->idx);
-					if( abs(idx - current->idx) < 4 || abs(idx - current->idx) >= 8 )
+					int idxDist = abs(idx - current.idx);
+					if( abs(idx - current.idx) < 4 || abs(idx - current.idx) >= 8 )
 					{
-						if(next.empty())
+						if(!hasNext)
 						{
-							next = cv::Ptr<StrokeDir> (new StrokeDir(idx, thresholdc, current->direction, strokeDir));
+							next = StrokeDir(idx, thresholdc, current.direction, strokeDir);
+							hasNext = true;
 							repeat = 0;
 						}
-						else if( idxDist < abs(next->idx - current->idx) )
+						else if( idxDist < abs(next.idx - current.idx) )
 						{
 							if( !single )
-								stack.push(next);
-							next = cv::Ptr<StrokeDir> (new StrokeDir(idx, thresholdc, current->direction, strokeDir));
+								stack.push_back(next);
+							next = StrokeDir(idx, thresholdc, current.direction, strokeDir);
 						}else if( !single )
 						{
-							stack.push(cv::Ptr<StrokeDir> (new StrokeDir(idx, thresholdc, current->direction, strokeDir)));
+							stack.push_back(StrokeDir(idx, thresholdc, current.direction, strokeDir));
 						}
 
 					}else if( !single ){
-						stack.push(cv::Ptr<StrokeDir> (new StrokeDir(idx, thresholdc, current->direction, strokeDir)));
+						stack.push_back(StrokeDir(idx, thresholdc, current.direction, strokeDir));
 					}
 					dCount++;
 				}
@@ -458,7 +514,7 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 		}
 	}
 
-	if(strokes.size() == 0 || strokes[0].size() == 0 )
+	if(strokes.size() == 0 || strokes.length(0) == 0 )
 	{
 		return -1;
 	}
@@ -492,12 +548,312 @@ int segmentStroke(cv::Mat& img, cv::Mat& segmMap, cv::Mat& idImage, cmp::FastKey
 
 #define INT_OFFSET 2
 
-void PyramidSegmenter::getLetterCandidates(cv::Mat& img, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels, std::vector<cmp::LetterCandidate*>& letters, cv::Mat debugImage, int minHeight)
+bool PyramidSegmenter::segmentSeed(size_t i, size_t option, bool computeStrokes, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels,
+		int& compCounter, SeedContext& ctx, SeedSegmentation& seg)
 {
+	seg.reset();
+	if(img1_keypoints[i].count == 6)
+		return false;
+	const SegmentOption& segOpt = segmentOptions[option];
 
 	int edgeThreshold = ftDetector->getEdgeThreshold();
+	vector<cv::Mat>& imagePyramid = ftDetector->getImagePyramid();
+	//the 16-bit scanline segments can not address images wider/taller than 65535 px
+	bool compactFill = isCompactFFillSize(imagePyramid[0].size());
+
+	cv::Rect& roi = seg.roi;
+	cv::Mat& segmImg = seg.segmImg;
+	std::vector<int>& keypointIds = seg.keypointIds;
+
+	int pyramidIndex = img1_keypoints[i].octave;
+	int pyramidIndexOffset = pyramidIndex;
+	double sf = 1 / ftDetector->getLevelScale(pyramidIndex);
+	cv::Point2f ptScaled =  img1_keypoints[i].pt;
+	ptScaled.x /= sf;
+	ptScaled.y /= sf;
+	ptScaled.x = round(ptScaled.x);
+	ptScaled.y = round(ptScaled.y);
+	cv::Point2f ptMaxDiffScaled =  img1_keypoints[i].intensityOut;
+	ptMaxDiffScaled.x /= sf;
+	ptMaxDiffScaled.x = round(ptMaxDiffScaled.x);
+	ptMaxDiffScaled.y /= sf;
+	ptMaxDiffScaled.y = round(ptMaxDiffScaled.y);
+	int compNo = 0;
+	long threshold  = 0;
+	int area = 0;
+	cv::Scalar intensityOut;
+	cv::Scalar intensityIn;
+	int projection = 0;
+	int kpCount = img1_keypoints[i].count;
+	if(kpCount == 5)
+		kpCount = 2;
+
+
+	intensityIn = imagePyramid[pyramidIndex].at<uchar>((int) ptScaled.y, (int) ptScaled.x);
+	int pixVal = 0;
+	int maxIntentsity = imagePyramid[pyramidIndex].at<uchar>((int) ptMaxDiffScaled.y, (int) ptMaxDiffScaled.x);
+	if(imagePyramid[pyramidIndex].type() == CV_8UC3)
+	{
+		int strokeCounter = i;
+		int strokeArea;
+
+		threshold = img1_keypoints[i].response;
+		seg.hasStrokes = true;
+		seg.appendStrokes = true;
+		//std::cout << "Type: " << (int) img1_keypoints[i].type << std::endl;
+		if( img1_keypoints[i].type == 1 ){
+			threshold -=  INT_OFFSET;
+			cv::Mat tmp;
+			switch(img1_keypoints[i].channel){
+			case 0:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<0>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			case 1:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<1>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			case 2:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<2>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			}
 
+		}else{
+			projection = 1;
+			threshold = - img1_keypoints[i].response + INT_OFFSET;
+			cv::Mat tmp;
+			switch(img1_keypoints[i].channel){
+			case 0:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<0>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			case 1:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<1>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			case 2:
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<2>, threshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				break;
+			}
+		}
+
+		if( compactFill )
+			compNo = floodFill( ctx.buffer, ctx.idPyramid[pyramidIndex], imagePyramid[pyramidIndex], ptScaled, img1_keypoints[i].channel, sf,
+					compCounter, threshold, kpCount * maxComponentSize, minCompSize, segmImg, ctx.segmPyramid[pyramidIndex], roi, area, keypointIndex[pyramidIndex], keypointIds, shapeStats ? &ctx.shapeAccumulator : NULL, &seg.shape, true, segmentGrad);
+		else
+			compNo = floodFill( ctx.bufferL, ctx.idPyramid[pyramidIndex], imagePyramid[pyramidIndex], ptScaled, img1_keypoints[i].channel, sf,
+					compCounter, threshold, kpCount * maxComponentSize, minCompSize, segmImg, ctx.segmPyramid[pyramidIndex], roi, area, keypointIndex[pyramidIndex], keypointIds, shapeStats ? &ctx.shapeAccumulator : NULL, &seg.shape, true, segmentGrad);
+		keypointIds.push_back(i);
+
+		//cv::imshow("ts", segmPyramid[pyramidIndex]);
+		//cv::waitKey(0);
+
+		//compNo = segmentCompRGB(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], threshold, compCounter, ccomp, roi, segmImg, maxComponentSize, true);
+	}else
+	{
+		pixVal = imagePyramid[pyramidIndex].at<uchar>((int) ptScaled.y, (int) ptScaled.x);
+		int dp = abs(pixVal - img1_keypoints[i].maxima);
+		int threshold = img1_keypoints[i].response;
+		threshold =  1 * (maxIntentsity - pixVal) / 3; //TODO remove !!!
+		//cv::Scalar intensityIn2 = imagePyramid[pyramidIndex].at<uchar>((int) ptMostSameScaled.y, (int) ptMostSameScaled.x);
+		intensityOut = imagePyramid[pyramidIndex].at<uchar>((int) ptMaxDiffScaled.y, (int) ptMaxDiffScaled.x);
+		if( intensityIn.val[0] <  maxIntentsity )
+		{
+			if(keypointsPixels.size() > 0 )
+				threshold = img1_keypoints[i].response - MAX(dp, 2);
+			else
+				threshold = img1_keypoints[i].response - INT_OFFSET;
+			if( img1_keypoints[i].count != 5 && computeStrokes && keypointsPixels.size() == 0 )
+			{
+				seg.hasStrokes = true;
+				seg.requestedStrokes = true;
+				int strokeArea;
+				cv::Mat tmp;
+				int strokeCounter = i;
+				int64 startTime = cv::getTickCount();
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGray, edgeThreshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				seg.strokesTime += cv::getTickCount() - startTime;
+			}
+			//compNo = segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayP, threshold, compCounter, segmImg, area, roi, strokes);
+			//compNo = segmentComp(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i].response + pixVal , compCounter, ccomp, roi, segmImg, maxComponentSize * 3 * (img1_keypoints[i].octave + 1 ), true );
+		}else
+		{
+			projection = 1;
+			if(keypointsPixels.size() > 0 )
+				threshold = -img1_keypoints[i].response + MAX(dp, 2);
+			else
+				threshold = -img1_keypoints[i].response + INT_OFFSET;
+			if( img1_keypoints[i].count != 5 && computeStrokes && keypointsPixels.size() == 0)
+			{
+				seg.hasStrokes = true;
+				seg.requestedStrokes = true;
+				int strokeArea;
+				cv::Mat tmp;
+				int strokeCounter = i;
+				int64 startTime = cv::getTickCount();
+				segmentStroke(imagePyramid[pyramidIndex], ctx.segmPyramid[pyramidIndex], ctx.idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayI, edgeThreshold, strokeCounter, tmp, strokeArea, roi, seg.strokes, true, pixelsOffset[pyramidIndex], maxStrokeLength );
+				seg.strokesTime += cv::getTickCount() - startTime;
+			}
+
+			//compNo = segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayIP, threshold, compCounter, segmImg, area, roi, strokes);
+			//compNo = segmentCompNegative(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i].response - pixVal, compCounter, ccomp, roi, segmImg, maxComponentSize * 3 * (img1_keypoints[i].octave + 1 ), true );
+		}
+		int seedThreshold = threshold;
+		if( abs(threshold) > 70 && segOpt.scoreFactor == 1.0)
+			threshold = 1 * threshold / 2;
+
+		if( intensityIn.val[0] <  maxIntentsity && ((this->segmentKeyPoints & 1) == 0 ) )
+			return false;
+		if( intensityIn.val[0] >  maxIntentsity && ((this->segmentKeyPoints & 2) == 0 ) )
+			return false;
+
+		if(img1_keypoints[i].isMerged)
+			return false;
+
+
+		if(pyramidIndex > 0)
+		{
+			pyramidIndexOffset += segmentLevelOffset;
+			sf = 1 / ftDetector->getLevelScale(pyramidIndexOffset);
+			ptScaled =  img1_keypoints[i].pt;
+			ptScaled.x /= sf;
+			ptScaled.y /= sf;
+		}
+
+		//compNo = segmentComp(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], threshold, compCounter, ccomp, roi, segmImg, maxComponentSize, true);
+		if( hasNestedOptions() )
+		{
+			//all the options are segmented at once, the next options of the seed just pick their level
+			if( ctx.levelsSeed != (int) i )
+			{
+				std::vector<long> thresholds;
+				for( const SegmentOption& opt : segmentOptions )
+				{
+					int optThreshold = seedThreshold;
+					if( abs(optThreshold) > 70 && opt.scoreFactor == 1.0)
+						optThreshold = 1 * optThreshold / 2;
+					thresholds.push_back(optThreshold * opt.scoreFactor);
+				}
+				if( compactFill )
+					floodFillLevels(ctx.buffer, ctx.idPyramid[pyramidIndexOffset], imagePyramid[pyramidIndexOffset], ptScaled, img1_keypoints[i].channel,
+							compCounter, thresholds, maxComponentSize, minCompSize, ctx.segmPyramid[pyramidIndexOffset], keypointIndex[pyramidIndex], shapeStats ? &ctx.shapeAccumulator : NULL, ctx.levels);
+				else
+					floodFillLevels(ctx.bufferL, ctx.idPyramid[pyramidIndexOffset], imagePyramid[pyramidIndexOffset], ptScaled, img1_keypoints[i].channel,
+							compCounter, thresholds, maxComponentSize, minCompSize, ctx.segmPyramid[pyramidIndexOffset], keypointIndex[pyramidIndex], shapeStats ? &ctx.shapeAccumulator : NULL, ctx.levels);
+				ctx.levelsSeed = i;
+			}
+			FloodFillLevel& level = ctx.levels[option];
+			compNo = level.compNo;
+			roi = level.rect;
+			area = level.area;
+			segmImg = level.segmImg;
+			keypointIds = level.keypointIds;
+			seg.shape = level.shape;
+		}
+		else if( compactFill )
+			compNo = floodFill( ctx.buffer, ctx.idPyramid[pyramidIndexOffset], imagePyramid[pyramidIndexOffset], ptScaled, img1_keypoints[i].channel, sf,
+					compCounter, threshold * segOpt.scoreFactor, maxComponentSize, minCompSize, segmImg, ctx.segmPyramid[pyramidIndexOffset], roi, area, keypointIndex[pyramidIndex], keypointIds, shapeStats ? &ctx.shapeAccumulator : NULL, &seg.shape, true, segOpt.segmentationType);
+		else
+			compNo = floodFill( ctx.bufferL, ctx.idPyramid[pyramidIndexOffset], imagePyramid[pyramidIndexOffset], ptScaled, img1_keypoints[i].channel, sf,
+					compCounter, threshold * segOpt.scoreFactor, maxComponentSize, minCompSize, segmImg, ctx.segmPyramid[pyramidIndexOffset], roi, area, keypointIndex[pyramidIndex], keypointIds, shapeStats ? &ctx.shapeAccumulator : NULL, &seg.shape, true, segOpt.segmentationType);
+		/*
+		std::cout << "Threshold: " << threshold << ", pix val:" << pixVal << ", cn:" << compNo << ", x:" << img1_keypoints[i].pt.x << "," << img1_keypoints[i].pt.y << std::endl;
+		cv::imshow("ts", segmPyramid[pyramidIndex]);
+		cv::waitKey(0);
+		*/
+	}
+
+	seg.compNo = compNo;
+	seg.area = area;
+	seg.sf = sf;
+	seg.pixVal = pixVal;
+	seg.projection = projection;
+	seg.intensityIn = intensityIn;
+	seg.intensityOut = intensityOut;
+	seg.valid = true;
+	return true;
+}
+
+/**
+ * Speculatively segments the seeds of one level/tile cell
+ *
+ * Every worker thread owns its id pyramid, so the flood fills of different cells do not interfere;
+ * the component ids are derived from the seed index, which makes the results independent of the scheduling.
+ */
+struct SeedWorkspace{
+
+	SeedWorkspace(): ctx(idPyramid, segmPyramid, buffer, bufferL){
+
+	}
+
+	std::vector<cv::Mat> idPyramid;
+	std::vector<cv::Mat> segmPyramid;
+	std::vector<CvFFillSegment> buffer;
+	std::vector<CvFFillSegmentL> bufferL;
+	SeedContext ctx;
+};
+
+class SeedSegmentationInvoker : public cv::ParallelLoopBody
+{
+private:
+	PyramidSegmenter& segmenter_;
+	const std::vector<std::vector<int> >& cells_;
+	std::vector<cmp::FastKeyPoint>& keypoints_;
+	std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels_;
+	const std::vector<SegmentOption>& segmentOptions_;
+	std::vector<SeedSegmentation>& seeds_;
+	cv::TLSData<SeedWorkspace> workspace_;
+
+	SeedSegmentationInvoker& operator=(const SeedSegmentationInvoker&); // to quiet MSVC
+
+public:
+
+	SeedSegmentationInvoker(PyramidSegmenter& segmenter, const std::vector<std::vector<int> >& cells, std::vector<cmp::FastKeyPoint>& keypoints,
+			std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels,
+			const std::vector<SegmentOption>& segmentOptions, std::vector<SeedSegmentation>& seeds)
+		: segmenter_(segmenter), cells_(cells), keypoints_(keypoints), keypointsPixels_(keypointsPixels),
+		  segmentOptions_(segmentOptions), seeds_(seeds)
+	{
+
+	}
+
+	void operator() (const cv::Range& range) const
+	{
+		vector<cv::Mat>& imagePyramid = segmenter_.ftDetector->getImagePyramid();
+		SeedWorkspace& ws = *workspace_.get();
+		//the buffers are reset once per thread, the fills match only their own id and the ids are unique in the image,
+		//so the ids left by the previous chunks of the thread do not change the result
+		if( ws.idPyramid.size() != imagePyramid.size() )
+		{
+			ws.idPyramid.resize(imagePyramid.size());
+			ws.segmPyramid.resize(imagePyramid.size());
+			for(size_t i = 0; i < imagePyramid.size(); i++)
+			{
+				ws.idPyramid[i] = cv::Mat(imagePyramid[i].rows, imagePyramid[i].cols, CV_32SC1, cv::Scalar(-1));
+				ws.segmPyramid[i] = cv::Mat::zeros(imagePyramid[i].rows, imagePyramid[i].cols, CV_8UC1);
+			}
+		}
+		SeedContext& ctx = ws.ctx;
+		ctx.levelsSeed = -1;
+
+		int idOffset = (int) keypoints_.size();
+		for (int c = range.start; c < range.end; ++c)
+		{
+			for( int i : cells_[c] )
+			{
+				for( size_t k = 0; k < segmentOptions_.size(); k++ )
+				{
+					int seedNo = i * segmentOptions_.size() + k;
+					//stroke ids are the keypoint indices, the component ids start above them
+					int compCounter = idOffset + seedNo;
+					//the candidates are known only in the serial pass, the strokes of every option are kept and used under its condition
+					segmenter_.segmentSeed(i, k, true, keypoints_, keypointsPixels_, compCounter, ctx, seeds_[seedNo]);
+				}
+			}
+		}
+	}
+};
+
+void PyramidSegmenter::getLetterCandidates(cv::Mat& img, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels, std::vector<cmp::LetterCandidate*>& letters, cv::Mat debugImage, int minHeight)
+{
 	classificationTime = 0;
+	preRejectedCount = 0;
 	if(!charClassifier.empty())
 		charClassifier->classificationTime = 0;
 	letterCandidates.clear();
@@ -522,24 +878,24 @@ void PyramidSegmenter::getLetterCandidates(cv::Mat& img, std::vector<cmp::FastKe
 	int lettersCount = 0;
 	vector<cv::Mat>& imagePyramid = ftDetector->getImagePyramid();
 
-	std::vector<std::unordered_map<int, int> > keypointHash;
-	keypointHash.resize(imagePyramid.size());
+	keypointIndex.resize(imagePyramid.size());
+	for( size_t i = 0; i < keypointIndex.size(); i++ )
+		keypointIndex[i].clear();
 	keypointStrokes.clear();
 	for(size_t i = 0; i < img1_keypoints.size(); i++)
 	{
 		if(img1_keypoints[i].count == 6)
 			continue;
 		double kpscale = ftDetector->getLevelScale(img1_keypoints[i].octave);
-		size_t index = ( (int) roundf(img1_keypoints[i].pt.x * kpscale) + roundf((int) img1_keypoints[i].pt.y * kpscale) * img.cols);
-		keypointHash[img1_keypoints[i].octave][index] = i;
+		keypointIndex[img1_keypoints[i].octave].add((int) roundf(img1_keypoints[i].pt.x * kpscale), (int) roundf((int) img1_keypoints[i].pt.y * kpscale), i, true);
 		if( img1_keypoints[i].octave > 0)
 		{
 			kpscale = ftDetector->getLevelScale(img1_keypoints[i].octave -1);
-			index = ( (int) roundf(img1_keypoints[i].pt.x * kpscale) + roundf((int) img1_keypoints[i].pt.y * kpscale) * img.cols);
-			if( keypointHash[img1_keypoints[i].octave - 1].find(index) == keypointHash[img1_keypoints[i].octave - 1].end() )
-				keypointHash[img1_keypoints[i].octave - 1][index] = i;
+			keypointIndex[img1_keypoints[i].octave - 1].add((int) roundf(img1_keypoints[i].pt.x * kpscale), (int) roundf((int) img1_keypoints[i].pt.y * kpscale), i, false);
 		}
 	}
+	for( size_t i = 0; i < keypointIndex.size(); i++ )
+		keypointIndex[i].build();
 	vector<double> scales = ftDetector->getScales();
 
 	if(segmPyramid.size() != imagePyramid.size() || segmPyramid[0].cols != img.cols || segmPyramid[0].rows != img.rows)
@@ -570,174 +926,69 @@ void PyramidSegmenter::getLetterCandidates(cv::Mat& img, std::vector<cmp::FastKe
 		}
 	}
 
+	std::vector<SeedSegmentation> seeds;
+	if( parallelSegmentation )
+	{
+		//partition the seeds by the pyramid level and spatial tile and segment them speculatively
+		std::map<std::pair<int, std::pair<int, int> >, std::vector<int> > cellMap;
+		for(size_t i = 0; i < img1_keypoints.size(); i++)
+		{
+			if(img1_keypoints[i].count == 6)
+				continue;
+			double kpscale = ftDetector->getLevelScale(img1_keypoints[i].octave);
+			int tx = (int) (img1_keypoints[i].pt.x * kpscale) / SEGM_TILE_SIZE;
+			int ty = (int) (img1_keypoints[i].pt.y * kpscale) / SEGM_TILE_SIZE;
+			cellMap[std::make_pair(img1_keypoints[i].octave, std::make_pair(ty, tx))].push_back(i);
+		}
+		std::vector<std::vector<int> > cells;
+		cells.reserve(cellMap.size());
+		for( auto& cell : cellMap )
+			cells.push_back(std::move(cell.second));
+
+		seeds.resize(img1_keypoints.size() * segmentOptions.size());
+		SeedSegmentationInvoker body(*this, cells, img1_keypoints, keypointsPixels, segmentOptions, seeds);
+		cv::parallel_for_(cv::Range(0, cells.size()), body, cv::getNumThreads());
+	}
+
+	SeedContext seedContext(idPyramid, segmPyramid, buffer, bufferL);
+	SeedSegmentation seedSegm;
 	std::vector<cv::Point> ccomp;
 	for(size_t i = 0; i < img1_keypoints.size(); i++)
 	{
 		LetterCandidate* prev = NULL;
 		int prevComp = -1;
-		for( SegmentOption& segOpt : segmentOptions )
+		for( size_t k = 0; k < segmentOptions.size(); k++ )
 		{
+			SeedSegmentation& seg = parallelSegmentation ? seeds[i * segmentOptions.size() + k] : seedSegm;
+			if( !parallelSegmentation )
+				segmentSeed(i, k, prev == NULL, img1_keypoints, keypointsPixels, compCounter, seedContext, seg);
 
-			if(img1_keypoints[i].count == 6)
+			//the strokes depending on the flag are used only until the first candidate of the seed, as segmentSeed(prev == NULL) computes them
+			if( seg.hasStrokes && (!seg.requestedStrokes || prev == NULL) )
+			{
+				keypointStrokes.store(i, seg.strokes, seg.appendStrokes);
+				strokesTime += seg.strokesTime;
+			}
+			if( !seg.valid )
+				continue;
+			//the speculative seed could have been merged by the preceding ones
+			if( img1_keypoints[i].isMerged && imagePyramid[0].type() != CV_8UC3 )
 				continue;
-			cv::Rect roi;
-			cv::Mat segmImg;
 
 			int pyramidIndex = img1_keypoints[i].octave;
-			int pyramidIndexOffset = pyramidIndex;
-			double sf = 1 / ftDetector->getLevelScale(pyramidIndex);
-			cv::Point2f ptScaled =  img1_keypoints[i].pt;
-			ptScaled.x /= sf;
-			ptScaled.y /= sf;
-			ptScaled.x = round(ptScaled.x);
-			ptScaled.y = round(ptScaled.y);
-			cv::Point2f ptMaxDiffScaled =  img1_keypoints[i].intensityOut;
-			ptMaxDiffScaled.x /= sf;
-			ptMaxDiffScaled.x = round(ptMaxDiffScaled.x);
-			ptMaxDiffScaled.y /= sf;
-			ptMaxDiffScaled.y = round(ptMaxDiffScaled.y);
-			int compNo = 0;
-			long threshold  = 0;
-			int area = 0;
-			cv::Scalar intensityOut;
-			cv::Scalar intensityIn;
-			int projection = 0;
-			int kpCount = img1_keypoints[i].count;
-			if(kpCount == 5)
-				kpCount = 2;
-
-
-			intensityIn = imagePyramid[pyramidIndex].at<uchar>((int) ptScaled.y, (int) ptScaled.x);
-			int pixVal = 0;
-			std::vector<int> keypointIds;
-			int maxIntentsity = imagePyramid[pyramidIndex].at<uchar>((int) ptMaxDiffScaled.y, (int) ptMaxDiffScaled.x);
-			if(imagePyramid[pyramidIndex].type() == CV_8UC3)
-			{
-				int strokeCounter = i;
-				int strokeArea;
-
-				threshold = img1_keypoints[i].response;
-				//std::cout << "Type: " << (int) img1_keypoints[i].type << std::endl;
-				if( img1_keypoints[i].type == 1 ){
-					threshold -=  INT_OFFSET;
-					cv::Mat tmp;
-					switch(img1_keypoints[i].channel){
-					case 0:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<0>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					case 1:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<1>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					case 2:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBP<2>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					}
-
-				}else{
-					projection = 1;
-					threshold = - img1_keypoints[i].response + INT_OFFSET;
-					cv::Mat tmp;
-					switch(img1_keypoints[i].channel){
-					case 0:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<0>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					case 1:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<1>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					case 2:
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceRGBIP<2>, threshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						break;
-					}
-				}
-
-				compNo = floodFill( buffer, idPyramid[pyramidIndex], imagePyramid[pyramidIndex], ptScaled, img1_keypoints[i].channel, sf,
-						compCounter, threshold, kpCount * maxComponentSize, minCompSize, segmImg, segmPyramid[pyramidIndex], roi, area, keypointHash[pyramidIndex], keypointIds, true, segmentGrad, img.cols);
-				keypointIds.push_back(i);
-
-				//cv::imshow("ts", segmPyramid[pyramidIndex]);
-				//cv::waitKey(0);
-
-				//compNo = segmentCompRGB(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], threshold, compCounter, ccomp, roi, segmImg, maxComponentSize, true);
-			}else
-			{
-				pixVal = imagePyramid[pyramidIndex].at<uchar>((int) ptScaled.y, (int) ptScaled.x);
-				int dp = abs(pixVal - img1_keypoints[i].maxima);
-				int threshold = img1_keypoints[i].response;
-				threshold =  1 * (maxIntentsity - pixVal) / 3; //TODO remove !!!
-				//cv::Scalar intensityIn2 = imagePyramid[pyramidIndex].at<uchar>((int) ptMostSameScaled.y, (int) ptMostSameScaled.x);
-				intensityOut = imagePyramid[pyramidIndex].at<uchar>((int) ptMaxDiffScaled.y, (int) ptMaxDiffScaled.x);
-				std::vector<std::vector<cv::Ptr<StrokeDir> > > strokes;
-				if( intensityIn.val[0] <  maxIntentsity )
-				{
-					if(keypointsPixels.size() > 0 )
-						threshold = img1_keypoints[i].response - MAX(dp, 2);
-					else
-						threshold = img1_keypoints[i].response - INT_OFFSET;
-					if( img1_keypoints[i].count != 5 && prev == NULL && keypointsPixels.size() == 0 )
-					{
-						keypointStrokes[i] = std::vector<std::vector<cv::Ptr<StrokeDir> > > ();
-						int strokeArea;
-						cv::Mat tmp;
-						int strokeCounter = i;
-						int64 startTime = cv::getTickCount();
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGray, edgeThreshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						strokesTime += cv::getTickCount() - startTime;
-					}
-					//compNo = segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayP, threshold, compCounter, segmImg, area, roi, strokes);
-					//compNo = segmentComp(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i].response + pixVal , compCounter, ccomp, roi, segmImg, maxComponentSize * 3 * (img1_keypoints[i].octave + 1 ), true );
-				}else
-				{
-					projection = 1;
-					if(keypointsPixels.size() > 0 )
-						threshold = -img1_keypoints[i].response + MAX(dp, 2);
-					else
-						threshold = -img1_keypoints[i].response + INT_OFFSET;
-					if( img1_keypoints[i].count != 5 && prev == NULL && keypointsPixels.size() == 0)
-					{
-						keypointStrokes[i] = std::vector<std::vector<cv::Ptr<StrokeDir> > >();
-						int strokeArea;
-						cv::Mat tmp;
-						int strokeCounter = i;
-						int64 startTime = cv::getTickCount();
-						segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayI, edgeThreshold, strokeCounter, tmp, strokeArea, roi, keypointStrokes[i], true, pixelsOffset[pyramidIndex], maxStrokeLength );
-						strokesTime += cv::getTickCount() - startTime;
-					}
-
-					//compNo = segmentStroke(imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i], sf, ColourDistanceGrayIP, threshold, compCounter, segmImg, area, roi, strokes);
-					//compNo = segmentCompNegative(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], img1_keypoints[i].response - pixVal, compCounter, ccomp, roi, segmImg, maxComponentSize * 3 * (img1_keypoints[i].octave + 1 ), true );
-				}
-				if( abs(threshold) > 70 && segOpt.scoreFactor == 1.0)
-					threshold = 1 * threshold / 2;
-
-				if( intensityIn.val[0] <  maxIntentsity && ((this->segmentKeyPoints & 1) == 0 ) )
-					continue;
-				if( intensityIn.val[0] >  maxIntentsity && ((this->segmentKeyPoints & 2) == 0 ) )
-					continue;
-
-				if(img1_keypoints[i].isMerged)
-					continue;
-
-
-				if(pyramidIndex > 0)
-				{
-					pyramidIndexOffset += segmentLevelOffset;
-					sf = 1 / ftDetector->getLevelScale(pyramidIndexOffset);
-					ptScaled =  img1_keypoints[i].pt;
-					ptScaled.x /= sf;
-					ptScaled.y /= sf;
-				}
-
-				//compNo = segmentComp(queue, ptScaled, imagePyramid[pyramidIndex], segmPyramid[pyramidIndex], idPyramid[pyramidIndex], threshold, compCounter, ccomp, roi, segmImg, maxComponentSize, true);
-				compNo = floodFill( buffer, idPyramid[pyramidIndexOffset], imagePyramid[pyramidIndexOffset], ptScaled, img1_keypoints[i].channel, sf,
-						compCounter, threshold * segOpt.scoreFactor, maxComponentSize, minCompSize, segmImg, segmPyramid[pyramidIndexOffset], roi, area, keypointHash[pyramidIndex], keypointIds, true, segOpt.segmentationType, img.cols);
-				/*
-				std::cout << "Threshold: " << threshold << ", pix val:" << pixVal << ", cn:" << compNo << ", x:" << img1_keypoints[i].pt.x << "," << img1_keypoints[i].pt.y << std::endl;
-				cv::imshow("ts", segmPyramid[pyramidIndex]);
-				cv::waitKey(0);
-				*/
-			}
+			int compNo = seg.compNo;
+			int area = seg.area;
+			double sf = seg.sf;
+			int pixVal = seg.pixVal;
+			int projection = seg.projection;
+			cv::Scalar& intensityIn = seg.intensityIn;
+			cv::Scalar& intensityOut = seg.intensityOut;
+			cv::Rect& roi = seg.roi;
+			cv::Mat& segmImg = seg.segmImg;
+			std::vector<int>& keypointIds = seg.keypointIds;
 
 			if(compNo == -1)
+
 			{
 				continue;
 			}
@@ -760,6 +1011,7 @@ void PyramidSegmenter::getLetterCandidates(cv::Mat& img, std::vector<cmp::FastKe
 				ref->intensityInt = intensityIn;
 				ref->intensityOut = intensityOut;
 				ref->keypointIds = keypointIds;
+				std::swap(ref->shape, seg.shape);
 				keypointToSegm[i] = compNo;
 
 				for( auto kpid : keypointIds){
@@ -894,6 +1146,7 @@ inline bool greater(uchar& a, int& b)
 void PyramidSegmenter::segmentStrokes(cv::Mat& img, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels, std::vector<cmp::LetterCandidate*>& letters, cv::Mat debugImage, int minHeight)
 {
 	classificationTime = 0;
+	preRejectedCount = 0;
 	if(!charClassifier.empty())
 		charClassifier->classificationTime = 0;
 	letterCandidates.clear();
@@ -1091,6 +1344,7 @@ void PyramidSegmenter::segmentStrokes(cv::Mat& img, std::vector<cmp::FastKeyPoin
 			r1->mask = mask;
 			r1->bbox = r;
 			r1->area = cv::countNonZero(mask);
+			r1->shape.valid = false;
 			r1->keypointIds.insert(r1->keypointIds.end(), r2->keypointIds.begin(), r2->keypointIds.end());
 			r1->duplicates.push_back(c1);
 			r2->duplicate = c1;
@@ -1099,6 +1353,7 @@ void PyramidSegmenter::segmentStrokes(cv::Mat& img, std::vector<cmp::FastKeyPoin
 			r2->mask = mask;
 			r2->bbox = r;
 			r2->area = cv::countNonZero(mask);
+			r2->shape.valid = false;
 			r2->keypointIds.insert(r2->keypointIds.end(), r1->keypointIds.begin(), r1->keypointIds.end());
 			r2->duplicates.push_back(c2);
 			r1->duplicate = c2;
@@ -39,6 +39,8 @@ namespace cmp
 {
 
 #define MIN_COMP_SIZE 12
+//the seed tile size (in the level pixels) of the parallel segmentation
+#define SEGM_TILE_SIZE 128
 
 /**
  * @class cmp::Segmenter
@@ -68,6 +70,14 @@ public:
 		return charClassifier;
 	}
 
+	/**
+	 * Sets the first stage of the classification cascade, the candidates rejected by it get zero quality
+	 * and skip the char classifier
+	 */
+	void setPreClassifier(cv::Ptr<CharPreClassifier> preClassifier){
+		this->preClassifier = preClassifier;
+	}
+
 	std::vector<LetterCandidate>& getLetterCandidates(){
 		return letterCandidates;
 	}
@@ -86,9 +96,12 @@ public:
 
 	int componentsCount = 0;
 
+	/** the number of candidates of the last image rejected by the pre-classifier */
+	int preRejectedCount = 0;
+
 	int64 strokesTime = 0;
 
-	std::unordered_map<int, std::vector<std::vector<cv::Ptr<StrokeDir> > > > keypointStrokes;
+	KeypointStrokes keypointStrokes;
 
 	int maxStrokeLength = 50;
 
@@ -102,8 +115,12 @@ protected:
 	cv::Mat idMap;
 
 	std::vector<CvFFillSegment> buffer;
+	/** segment buffer used for images exceeding the 16-bit coordinate range */
+	std::vector<CvFFillSegmentL> bufferL;
 	std::vector<cv::Point> queue;
 
+	cv::Ptr<CharPreClassifier> preClassifier;
+
 	cv::Ptr<CharClassifier> charClassifier;
 
 	cv::Ptr<CharClassifier> wordClassifier;
@@ -127,6 +144,83 @@ struct SegmentOption{
 	float scoreFactor;
 };
 
+/**
+ * The working images and buffers mutated by the segmentation of a single seed
+ */
+struct SeedContext{
+
+	SeedContext(std::vector<cv::Mat>& idPyramid, std::vector<cv::Mat>& segmPyramid, std::vector<CvFFillSegment>& buffer, std::vector<CvFFillSegmentL>& bufferL):
+		idPyramid(idPyramid), segmPyramid(segmPyramid), buffer(buffer), bufferL(bufferL){
+
+	}
+
+	std::vector<cv::Mat>& idPyramid;
+	std::vector<cv::Mat>& segmPyramid;
+	std::vector<CvFFillSegment>& buffer;
+	std::vector<CvFFillSegmentL>& bufferL;
+
+	/** the components of all segmentation options of the seed levelsSeed */
+	int levelsSeed = -1;
+	std::vector<FloodFillLevel> levels;
+
+	/** the scratch buffers of the shape statistics */
+	ShapeAccumulator shapeAccumulator;
+};
+
+/**
+ * The segmentation result of a single seed (keypoint and segmentation option)
+ */
+struct SeedSegmentation{
+
+	bool valid = false;
+
+	int compNo = 0;
+	int area = 0;
+	double sf = 1.0;
+	int pixVal = 0;
+	int projection = 0;
+
+	cv::Scalar intensityIn;
+	cv::Scalar intensityOut;
+	cv::Rect roi;
+	cv::Mat segmImg;
+	std::vector<int> keypointIds;
+	/** the shape statistics of segmImg, valid if accumulated during the fill */
+	ShapeStats shape;
+
+	/** the strokes found from the seed, appended to or replacing the keypoint strokes */
+	bool hasStrokes = false;
+	bool appendStrokes = false;
+	/** the strokes were requested by the computeStrokes flag of the seed */
+	bool requestedStrokes = false;
+	StrokeTrace strokes;
+	int64 strokesTime = 0;
+
+	/**
+	 * resets the record for the next seed, the storage of the buffers is kept
+	 */
+	void reset()
+	{
+		valid = false;
+		compNo = 0;
+		area = 0;
+		sf = 1.0;
+		pixVal = 0;
+		projection = 0;
+		intensityIn = cv::Scalar();
+		intensityOut = cv::Scalar();
+		roi = cv::Rect();
+		segmImg = cv::Mat();
+		keypointIds.clear();
+		shape.valid = false;
+		hasStrokes = false;
+		appendStrokes = false;
+		requestedStrokes = false;
+		strokes.clear();
+		strokesTime = 0;
+	}
+};
+
 class PyramidSegmenter : public Segmenter
 {
 public:
@@ -153,12 +247,53 @@ public:
 		return index;
 	}
 
+	/** if true, the seeds are flood-filled in parallel and merged in the keypoint order afterwards */
+	bool parallelSegmentation = false;
+
+	/** if true, the shape statistics of the candidates are accumulated during the flood fill (see ShapeStats), off by default with the first classifier stage using them */
+	bool shapeStats = false;
+
+	/**
+	 * Sets the segmentation options of the seeds, several intensity fill options are segmented in one nested fill
+	 */
+	void setSegmentOptions(const std::vector<SegmentOption>& segmentOptions){
+		CV_Assert( !segmentOptions.empty() );
+		this->segmentOptions = segmentOptions;
+	}
+
+	const std::vector<SegmentOption>& getSegmentOptions() const {
+		return segmentOptions;
+	}
+
 private:
+
+	friend class SeedSegmentationInvoker;
+
+	/**
+	 * @return true if the seeds are segmented at several thresholds of the same fill, which gives nested components
+	 */
+	inline bool hasNestedOptions() const
+	{
+		if( segmentOptions.size() < 2 )
+			return false;
+		for( const SegmentOption& opt : segmentOptions )
+		{
+			if( opt.segmentationType != 0 )
+				return false;
+		}
+		return true;
+	}
+
+	bool segmentSeed(size_t i, size_t option, bool computeStrokes, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels,
+			int& compCounter, SeedContext& ctx, SeedSegmentation& seg);
+
 	cv::Ptr<cmp::FTPyr> ftDetector;
 
 	std::vector<cv::Mat> segmPyramid;
 	std::vector<cv::Mat> idPyramid;
 	std::vector<int*> pixelsOffset;
+	/** the keypoint positions of each pyramid level */
+	std::vector<KeypointIndex> keypointIndex;
 
 	float threshodFactor;
 
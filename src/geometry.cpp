@@ -6,6 +6,8 @@
  */
 
 #include <set>
+#include <algorithm>
+#include <cfloat>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "geometry.h"
@@ -99,34 +101,41 @@ double innerAngle(const cv::Point& line1, const cv::Point& line2)
 	return M_PI - atan2(det, dot); //  # atan2(y, x) or atan2(sin, cos)
 }
 
-int rotatedRectangleIntersection( const cv::RotatedRect& rect1, const cv::RotatedRect& rect2, cv::OutputArray intersectingRegion )
+static const float samePointEps = 0.00001f; // used to test if two points are the same
+/** the maximal corner offset of a rectangle considered to be axis aligned */
+static const float axisAlignedEps = 0.001f;
+
+/**
+ * @return true if each corner of the rectangle 1 is a corner of the rectangle 2, in any order
+ * (the same rectangle rotated by 90 degrees with the swapped sides has its corners shifted)
+ */
+static inline bool sameCorners( const cv::Point2f pts1[4], const cv::Point2f pts2[4] )
 {
-    const float samePointEps = 0.00001f; // used to test if two points are the same
+    for( int i = 0; i < 4; i++ )
+    {
+        bool found = false;
+        for( int j = 0; j < 4 && !found; j++ )
+            found = fabs(pts1[i].x - pts2[j].x) <= samePointEps && fabs(pts1[i].y - pts2[j].y) <= samePointEps;
+        if( !found )
+            return false;
+    }
+    return true;
+}
 
+/**
+ * The general intersection of two rectangles by the edges clipping
+ */
+static int clipRectangles( const cv::Point2f pts1[4], const cv::Point2f pts2[4], std::vector<cv::Point2f>& intersection )
+{
     cv::Point2f vec1[4], vec2[4];
-    cv::Point2f pts1[4], pts2[4];
-
-    std::vector <cv::Point2f> intersection;
 
-    rect1.points(pts1);
-    rect2.points(pts2);
+    intersection.clear();
 
     int ret = INTERSECT_FULL;
 
     // Specical case of rect1 == rect2
     {
-        bool same = true;
-
-        for( int i = 0; i < 4; i++ )
-        {
-            if( fabs(pts1[i].x - pts2[i].x) > samePointEps || (fabs(pts1[i].y - pts2[i].y) > samePointEps) )
-            {
-                same = false;
-                break;
-            }
-        }
-
-        if(same)
+        if( sameCorners(pts1, pts2) )
         {
             intersection.resize(4);
 
@@ -135,8 +144,6 @@ int rotatedRectangleIntersection( const cv::RotatedRect& rect1, const cv::Rotate
                 intersection[i] = pts1[i];
             }
 
-            cv::Mat(intersection).copyTo(intersectingRegion);
-
             return INTERSECT_FULL;
         }
     }
@@ -296,11 +303,156 @@ int rotatedRectangleIntersection( const cv::RotatedRect& rect1, const cv::Rotate
     // If this check fails then it means we're getting dupes, increase samePointEps
     //CV_Assert( intersection.size() <= 8 );
 
-    cv::Mat(intersection).copyTo(intersectingRegion);
+    return ret;
+}
+
+/**
+ * @return true if the rectangle given by the corners has the edges parallel to the axes
+ */
+static inline bool isAxisAligned( const cv::Point2f pts[4] )
+{
+    return ( fabs(pts[0].x - pts[1].x) < axisAlignedEps && fabs(pts[1].y - pts[2].y) < axisAlignedEps )
+            || ( fabs(pts[0].y - pts[1].y) < axisAlignedEps && fabs(pts[1].x - pts[2].x) < axisAlignedEps );
+}
+
+/**
+ * @return true if the projections of the rectangles on the normals of the rect1 edges are separated
+ */
+static inline bool isSeparated( const cv::Point2f pts1[4], const cv::Point2f pts2[4] )
+{
+    for( int i = 0; i < 2; i++ )
+    {
+        float nx = -(pts1[i+1].y - pts1[i].y);
+        float ny = pts1[i+1].x - pts1[i].x;
+        float min1 = FLT_MAX, max1 = -FLT_MAX, min2 = FLT_MAX, max2 = -FLT_MAX;
+        for( int j = 0; j < 4; j++ )
+        {
+            float p1 = nx * pts1[j].x + ny * pts1[j].y;
+            float p2 = nx * pts2[j].x + ny * pts2[j].y;
+            min1 = MIN(min1, p1);
+            max1 = MAX(max1, p1);
+            min2 = MIN(min2, p2);
+            max2 = MAX(max2, p2);
+        }
+        float eps = samePointEps * (fabs(nx) + fabs(ny));
+        if( max1 + eps < min2 || max2 + eps < min1 )
+            return true;
+    }
+    return false;
+}
+
+static inline cv::Rect_<float> cornersBox( const cv::Point2f pts[4] )
+{
+    float minX = MIN(MIN(pts[0].x, pts[1].x), MIN(pts[2].x, pts[3].x));
+    float maxX = MAX(MAX(pts[0].x, pts[1].x), MAX(pts[2].x, pts[3].x));
+    float minY = MIN(MIN(pts[0].y, pts[1].y), MIN(pts[2].y, pts[3].y));
+    float maxY = MAX(MAX(pts[0].y, pts[1].y), MAX(pts[2].y, pts[3].y));
+    return cv::Rect_<float>(minX, minY, maxX - minX, maxY - minY);
+}
+
+/**
+ * The tiered intersection: the bounding boxes and the separating axes rejection,
+ * the axis aligned rectangles in O(1) and the general clipping for the rest
+ *
+ * @param axisBox the intersection of the axis aligned rectangles, set if the general clipping was not needed and the result is not INTERSECT_NONE
+ * @return the intersection type, -1 if the general clipping is needed
+ */
+static int intersectFast( const cv::Point2f pts1[4], const cv::Point2f pts2[4], cv::Rect_<float>& axisBox )
+{
+    cv::Rect_<float> box1 = cornersBox(pts1);
+    cv::Rect_<float> box2 = cornersBox(pts2);
+    if( box1.x + box1.width + samePointEps < box2.x || box2.x + box2.width + samePointEps < box1.x
+            || box1.y + box1.height + samePointEps < box2.y || box2.y + box2.height + samePointEps < box1.y )
+        return INTERSECT_NONE;
+
+    if( isAxisAligned(pts1) && isAxisAligned(pts2) )
+    {
+        float x0 = MAX(box1.x, box2.x);
+        float y0 = MAX(box1.y, box2.y);
+        float x1 = MIN(box1.x + box1.width, box2.x + box2.width);
+        float y1 = MIN(box1.y + box1.height, box2.y + box2.height);
+        //the touching rectangles are left to the clipping, it gives the contact points
+        if( x1 - x0 <= samePointEps || y1 - y0 <= samePointEps )
+            return -1;
+        axisBox = cv::Rect_<float>(x0, y0, x1 - x0, y1 - y0);
+        bool inside1 = box1.x > box2.x && box1.y > box2.y && box1.x + box1.width < box2.x + box2.width && box1.y + box1.height < box2.y + box2.height;
+        bool inside2 = box2.x > box1.x && box2.y > box1.y && box2.x + box2.width < box1.x + box1.width && box2.y + box2.height < box1.y + box1.height;
+        return inside1 || inside2 || sameCorners(pts1, pts2) ? INTERSECT_FULL : INTERSECT_PARTIAL;
+    }
+
+    if( isSeparated(pts1, pts2) || isSeparated(pts2, pts1) )
+        return INTERSECT_NONE;
+    return -1;
+}
+
+int rotatedRectangleIntersection( const cv::RotatedRect& rect1, const cv::RotatedRect& rect2, cv::OutputArray intersectingRegion )
+{
+    cv::Point2f pts1[4], pts2[4];
+    rect1.points(pts1);
+    rect2.points(pts2);
 
+    cv::Rect_<float> axisBox;
+    int ret = intersectFast(pts1, pts2, axisBox);
+    if( ret == INTERSECT_NONE )
+        return ret;
+    std::vector<cv::Point2f> intersection;
+    if( ret == -1 )
+    {
+        ret = clipRectangles(pts1, pts2, intersection);
+        if( ret == INTERSECT_NONE )
+            return ret;
+    }
+    else
+    {
+        intersection.resize(4);
+        intersection[0] = cv::Point2f(axisBox.x, axisBox.y);
+        intersection[1] = cv::Point2f(axisBox.x + axisBox.width, axisBox.y);
+        intersection[2] = cv::Point2f(axisBox.x + axisBox.width, axisBox.y + axisBox.height);
+        intersection[3] = cv::Point2f(axisBox.x, axisBox.y + axisBox.height);
+    }
+    cv::Mat(intersection).copyTo(intersectingRegion);
     return ret;
 }
 
+float rotatedRectangleIntersectionArea( const cv::RotatedRect& rect1, const cv::RotatedRect& rect2, int* type )
+{
+    cv::Point2f pts1[4], pts2[4];
+    rect1.points(pts1);
+    rect2.points(pts2);
+
+    cv::Rect_<float> axisBox;
+    int ret = intersectFast(pts1, pts2, axisBox);
+    if( type != NULL )
+        *type = ret;
+    if( ret == INTERSECT_NONE )
+        return 0;
+    if( ret != -1 )
+        return axisBox.area();
+
+    std::vector<cv::Point2f> intersection;
+    ret = clipRectangles(pts1, pts2, intersection);
+    if( type != NULL )
+        *type = ret;
+    if( intersection.size() < 3 )
+        return 0;
+    //the intersection is convex, the points are ordered by the angle around its centroid
+    cv::Point2f center(0, 0);
+    for( size_t i = 0; i < intersection.size(); i++ )
+        center += intersection[i];
+    center *= 1.0f / intersection.size();
+    std::sort(intersection.begin(), intersection.end(), [&](const cv::Point2f& a, const cv::Point2f& b) -> bool {
+        return atan2(a.y - center.y, a.x - center.x) < atan2(b.y - center.y, b.x - center.x);
+    });
+    double area = 0;
+    for( size_t i = 0; i < intersection.size(); i++ )
+    {
+        const cv::Point2f& p = intersection[i];
+        const cv::Point2f& q = intersection[(i + 1) % intersection.size()];
+        area += (double) p.x * q.y - (double) q.x * p.y;
+    }
+    return (float) fabs(area) / 2;
+}
+
 void getConvexHullLines(std::vector<cv::Point>& cHullPoints1, std::vector<cv::Point>& cHullPoints2, const cv::Mat& img, std::vector<cv::Vec4i>& convexLines, std::vector<cv::Point>& chull, double& dist)
 {
 	std::vector<cv::Point> allHullPoins;
@@ -35,8 +35,17 @@ enum RectanglesIntersectTypes {
     INTERSECT_FULL  = 2 //!< One of the rectangle is fully enclosed in the other
 };
 
+/**
+ * The intersection of the rotated rectangles, the axis aligned and the separated rectangles are resolved without the polygon clipping
+ */
 int rotatedRectangleIntersection( const cv::RotatedRect& rect1, const cv::RotatedRect& rect2, cv::OutputArray intersectingRegion );
 
+/**
+ * @param type if not NULL, set to the intersection type (see RectanglesIntersectTypes)
+ * @return the area of the rectangles intersection, the intersection polygon is not returned
+ */
+float rotatedRectangleIntersectionArea( const cv::RotatedRect& rect1, const cv::RotatedRect& rect2, int* type = NULL );
+
 void getConvexHullLines(std::vector<cv::Point>& cHullPoints1, std::vector<cv::Point>& cHullPoints2, const cv::Mat& img, std::vector<cv::Vec4i>& convexLines, std::vector<cv::Point>& chull, double& dist);
 
 /**
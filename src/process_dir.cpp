@@ -30,6 +30,17 @@ using namespace cmp;
 
 int main(int argc, char **argv)
 {
+	if( argc > 3 && std::string(argv[1]) == "--convert-model" )
+	{
+		//converts the xml char classifier model to the binary one
+		cmp::CvBoostCharClassifier classifier(argv[2]);
+		if( !classifier.saveBinary(argv[3]) )
+		{
+			std::cerr << "The model " << argv[2] << " can not be converted" << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
 
 	//cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
@@ -35,6 +35,7 @@
 #include "flood_fill.h"
 
 #include <unordered_map>
+#include <algorithm>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/core/core_c.h>
@@ -46,11 +47,11 @@ namespace cmp{
 
 #define ICV_PUSH( Y, L, R, PREV_L, PREV_R, DIR )  \
 {                                                 \
-    tail->y = (ushort)(Y);                        \
-    tail->l = (ushort)(L);                        \
-    tail->r = (ushort)(R);                        \
-    tail->prevl = (ushort)(PREV_L);               \
-    tail->prevr = (ushort)(PREV_R);               \
+    tail->y = (_Ct)(Y);                           \
+    tail->l = (_Ct)(L);                           \
+    tail->r = (_Ct)(R);                           \
+    tail->prevl = (_Ct)(PREV_L);                  \
+    tail->prevr = (_Ct)(PREV_R);                  \
     tail->dir = (short)(DIR);                     \
     if( ++tail == buffer_end )                    \
     {                                             \
@@ -75,13 +76,14 @@ namespace cmp{
 #define UP 1
 #define DOWN -1
 
-template<typename _Tp>
+template<typename _Tp, typename _St>
 static void
 icvFloodGrad_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize roi, CvPoint seed, int newVal,
-		CvConnectedComp* region, std::vector<CvFFillSegment>* buffer, long threshold, int maxSize, long (*diff)(const _Tp*, const _Tp*), cv::Mat& segmImg )
+		CvConnectedComp* region, std::vector<_St>* buffer, long threshold, int maxSize, long (*diff)(const _Tp*, const _Tp*), cv::Mat& segmImg )
 {
-    int* idImg = (int*)(idImage + stepId * seed.y);
-    _Tp* imgPtr = (_Tp*)(image + stepY * seed.y);
+    typedef typename _St::coord_type _Ct;
+    int* idImg = (int*)(idImage + (size_t)stepId * seed.y);
+    _Tp* imgPtr = (_Tp*)(image + (size_t)stepY * seed.y);
 
     threshold = abs(threshold);
 
@@ -89,7 +91,7 @@ icvFloodGrad_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize r
     int area = 0;
     int XMin, XMax, YMin = seed.y, YMax = seed.y;
     int _8_connectivity = 1;
-    CvFFillSegment* buffer_end = &buffer->front() + buffer->size(), *head = &buffer->front(), *tail = &buffer->front();
+    _St* buffer_end = &buffer->front() + buffer->size(), *head = &buffer->front(), *tail = &buffer->front();
 
     L = R = XMin = XMax = seed.x;
 
@@ -146,12 +148,12 @@ icvFloodGrad_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize r
             	continue;
             assert((YC + dir) < roi.height);
             assert((YC) < roi.height);
-            idImg = (int*)(idImage + (YC + dir) * stepId);
+            idImg = (int*)(idImage + (size_t)(YC + dir) * stepId);
 #ifndef NDEBUG
             uchar* simg = segmImg.ptr<uchar>((YC + dir));
 #endif
-            imgPtr = (_Tp*)(image + stepY * (YC + dir));
-            _Tp* img1 = (_Tp*)(image + YC * stepY);
+            imgPtr = (_Tp*)(image + (size_t)stepY * (YC + dir));
+            _Tp* img1 = (_Tp*)(image + (size_t)YC * stepY);
 
             int left = data[k][1];
             int right = data[k][2];
@@ -233,20 +235,21 @@ icvFloodGrad_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize r
     }
 }
 
-template<typename _Tp>
+template<typename _Tp, typename _St>
 static void
 icvFloodFill_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize roi, CvPoint seed, int newVal,
-		CvConnectedComp* region, std::vector<CvFFillSegment>* buffer, long threshold, int maxSize, long (*distFunction)(const _Tp&, const _Tp&), cv::Mat& segmImg )
+		CvConnectedComp* region, std::vector<_St>* buffer, long threshold, int maxSize, long (*distFunction)(const _Tp&, const _Tp&), cv::Mat& segmImg )
 {
-    int* idImg = (int*)(idImage + stepId * seed.y);
-    _Tp* imgPtr = (_Tp*)(image + stepY * seed.y);
+    typedef typename _St::coord_type _Ct;
+    int* idImg = (int*)(idImage + (size_t)stepId * seed.y);
+    _Tp* imgPtr = (_Tp*)(image + (size_t)stepY * seed.y);
     _Tp& seedPtr = imgPtr[seed.x];
 
     int i, L, R;
     int area = 0;
     int XMin, XMax, YMin = seed.y, YMax = seed.y;
     int _8_connectivity = 1;
-    CvFFillSegment* buffer_end = &buffer->front() + buffer->size(), *head = &buffer->front(), *tail = &buffer->front();
+    _St* buffer_end = &buffer->front() + buffer->size(), *head = &buffer->front(), *tail = &buffer->front();
 
     L = R = XMin = XMax = seed.x;
 
@@ -297,8 +300,8 @@ icvFloodFill_CnIR( uchar* idImage, int stepId, uchar* image, int stepY, CvSize r
         for( k = 0; k < 3; k++ )
         {
             dir = data[k][0];
-            idImg = (int*)(idImage + (YC + dir) * stepId);
-            imgPtr = (_Tp*)(image + stepY * (YC + dir));
+            idImg = (int*)(idImage + (size_t)(YC + dir) * stepId);
+            imgPtr = (_Tp*)(image + (size_t)stepY * (YC + dir));
             int left = data[k][1];
             int right = data[k][2];
 
@@ -361,8 +364,9 @@ static inline CvSize cvGetMatSize( const CvMat* mat )
     return size;
 }
 
-void
-floodFillC( std::vector<CvFFillSegment>& buffer, CvArr* idarr, CvArr* arr, CvPoint seed_point,
+template<typename _St>
+static void
+floodFillC( std::vector<_St>& buffer, CvArr* idarr, CvArr* arr, CvPoint seed_point,
              int channel, int  newVal, CvScalar lo_diff, CvScalar up_diff,
              CvConnectedComp* comp, long threshold, int maxSize, cv::Mat& segmImg, bool gradFill)
 {
@@ -399,6 +403,9 @@ floodFillC( std::vector<CvFFillSegment>& buffer, CvArr* idarr, CvArr* arr, CvPoi
         (unsigned)seed_point.y >= (unsigned)size.height )
         CV_Error( CV_StsOutOfRange, "Seed point is outside of image" );
 
+    if( sizeof(typename _St::coord_type) < sizeof(int) && !isCompactFFillSize(cv::Size(size.width, size.height)) )
+        CV_Error( CV_StsOutOfRange, "Image is too large for the compact flood fill segments, use CvFFillSegmentL buffer" );
+
     buffer_size = MAX( size.width, size.height ) * 2;
     buffer.clear();
     buffer.resize( buffer_size );
@@ -420,7 +427,7 @@ floodFillC( std::vector<CvFFillSegment>& buffer, CvArr* idarr, CvArr* arr, CvPoi
     }
     else if( type == CV_8UC3 )
     {
-    	std::vector<CvFFillSegment> buffer2;
+    	std::vector<_St> buffer2;
     	buffer2.resize( buffer_size );
     	if(threshold > 0)
         {
@@ -460,9 +467,10 @@ floodFillC( std::vector<CvFFillSegment>& buffer, CvArr* idarr, CvArr* arr, CvPoi
     	CV_Error( CV_StsUnsupportedFormat, "" );
 }
 
-int floodFill( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel, double scaleFactor,
-		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, std::unordered_map<int, int>& keypointHash, std::vector<int>& keypointIds,  bool resegment,
-		bool gradFill, int srcCols, cv::Scalar loDiff, cv::Scalar upDiff)
+template<typename _St>
+int floodFill( std::vector<_St>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel, double scaleFactor,
+		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, const KeypointIndex& keypointIndex, std::vector<int>& keypointIds,  ShapeAccumulator* accumulator, ShapeStats* shape,
+		bool resegment, bool gradFill, cv::Scalar loDiff, cv::Scalar upDiff)
 {
     CvConnectedComp ccomp;
     CvMat c_image = _image.getMat();
@@ -470,7 +478,7 @@ int floodFill( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageI
 
     if(! resegment )
     {
-    	int* checkRow = (int*) (c_imageId.data.ptr + seedPoint.y * c_imageId.step);
+    	int* checkRow = (int*) (c_imageId.data.ptr + (size_t)seedPoint.y * c_imageId.step);
     	if(checkRow[seedPoint.x] > 0)
     		return checkRow[seedPoint.x];
     }
@@ -487,31 +495,514 @@ int floodFill( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageI
     	return -1;
 
     segmImg = cv::Mat::zeros( ccomp.rect.height, ccomp.rect.width, CV_8UC1 );
+    if( accumulator && shape )
+        accumulator->begin(ccomp.rect.width);
     for (int y = 0; y < ccomp.rect.height; y++  )
     {
-    	int* rowId  = (int*)(c_imageId.data.ptr + c_imageId.step * (y + ccomp.rect.y));
+    	int* rowId  = (int*)(c_imageId.data.ptr + (size_t)c_imageId.step * (y + ccomp.rect.y));
     	uchar* rowSegm = &segmImg.at<uchar>(y * segmImg.step);
-    	int ybase = ((int) roundf(((y + ccomp.rect.y)))) * srcCols;
     	for(int x = 0; x <  ccomp.rect.width; x++)
     	{
     		if( rowId[x + ccomp.rect.x] == compCounter)
     		{
     			rowSegm[x] = 255;
-    			int index = ( (ybase) + roundf((x + ccomp.rect.x)));
-    			if( keypointHash.find( index ) != keypointHash.end()  )
-    			{
-    				keypointIds.push_back(keypointHash[index]);
-    			}
 #ifndef NDEBUG
     			segmMap.at<uchar>(y + ccomp.rect.y, x + ccomp.rect.x) = 255;
 #endif
     		}
     	}
+    	if( accumulator && shape )
+    		accumulator->addRow(rowSegm);
+    	const KeypointIndex::Entry* kpEnd = keypointIndex.rowEnd(y + ccomp.rect.y);
+    	for( const KeypointIndex::Entry* kp = keypointIndex.lowerBound(y + ccomp.rect.y, ccomp.rect.x); kp != kpEnd && kp->x < ccomp.rect.x + ccomp.rect.width; kp++ )
+    	{
+    		if( rowSegm[kp->x - ccomp.rect.x] != 0 )
+    			keypointIds.push_back(kp->id);
+    	}
     }
+    if( accumulator && shape )
+        accumulator->finish(*shape);
     area = ccomp.area;
     return compCounter;
 }
 
+template int floodFill<CvFFillSegment>( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel, double scaleFactor,
+		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, const KeypointIndex& keypointIndex, std::vector<int>& keypointIds,  ShapeAccumulator* accumulator, ShapeStats* shape,
+		bool resegment, bool gradFill, cv::Scalar loDiff, cv::Scalar upDiff);
+
+template int floodFill<CvFFillSegmentL>( std::vector<CvFFillSegmentL>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel, double scaleFactor,
+		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, const KeypointIndex& keypointIndex, std::vector<int>& keypointIds,  ShapeAccumulator* accumulator, ShapeStats* shape,
+		bool resegment, bool gradFill, cv::Scalar loDiff, cv::Scalar upDiff);
+
+void KeypointIndex::build()
+{
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) -> bool
+    {
+        if( a.y != b.y )
+            return a.y < b.y;
+        return a.x < b.x;
+    });
+
+    entries.clear();
+    rowStart.clear();
+    int rows = pending.empty() ? 0 : MAX(pending.back().y + 1, 0);
+    rowStart.assign(rows + 1, 0);
+    for( size_t i = 0; i < pending.size(); )
+    {
+        //the same position is resolved in the insertion order
+        size_t j = i;
+        int id = -1;
+        for( ; j < pending.size() && pending[j].y == pending[i].y && pending[j].x == pending[i].x; j++ )
+        {
+            if( pending[j].replace || id == -1 )
+                id = pending[j].id;
+        }
+        if( pending[i].y >= 0 )
+        {
+            Entry e = {pending[i].x, id};
+            entries.push_back(e);
+            rowStart[pending[i].y + 1]++;
+        }
+        i = j;
+    }
+    for( int y = 0; y < rows; y++ )
+        rowStart[y + 1] += rowStart[y];
+    pending.clear();
+}
+
+void ShapeAccumulator::begin(int width)
+{
+    this->width = width;
+    y = 0;
+    shape.valid = false;
+    shape.bbox = cv::Rect();
+    shape.area = shape.perimeter = shape.holes = shape.holesArea = 0;
+    shape.euler = 1;
+    shape.m10 = shape.m01 = shape.m20 = shape.m11 = shape.m02 = 0;
+    above.assign(width + 2, 0);
+    current.assign(width + 2, 0);
+    below.assign(width + 2, 0);
+    extremes.clear();
+    shape.hull.clear();
+    runs.clear();
+    prevRuns.clear();
+    parent.clear();
+    labelArea.clear();
+    exterior.clear();
+}
+
+int ShapeAccumulator::find(int label)
+{
+    while( parent[label] != label )
+    {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+void ShapeAccumulator::unite(int label1, int label2)
+{
+    label1 = find(label1);
+    label2 = find(label2);
+    if( label1 == label2 )
+        return;
+    parent[label2] = label1;
+    labelArea[label1] += labelArea[label2];
+    exterior[label1] |= exterior[label2];
+}
+
+void ShapeAccumulator::countBoundary()
+{
+    //the pixels of the current row touching the background
+    const uchar* a = &above[1];
+    const uchar* c = &current[1];
+    const uchar* b = &below[1];
+    for( int x = 0; x < width; x++ )
+    {
+        if( c[x] && !(c[x - 1] && c[x + 1] && a[x] && b[x]) )
+            shape.perimeter++;
+    }
+}
+
+void ShapeAccumulator::addRow(const uchar* row)
+{
+    uchar* b = &below[1];
+    runs.clear();
+    int rowMin = -1, rowMax = -1;
+    for( int x = 0; x < width; )
+    {
+        int x0 = x;
+        uchar fg = row[x] != 0;
+        for( ; x < width && (row[x] != 0) == fg; x++ )
+            b[x] = fg;
+        int x1 = x - 1;
+        double n = x - x0;
+        if( fg )
+        {
+            if( rowMin == -1 )
+                rowMin = x0;
+            rowMax = x1;
+            shape.area += (int) n;
+            double sx = (x0 + x1) * n / 2;
+            //sum of x^2 over the run
+            double sxx = (x1 * (x1 + 1.0) * (2.0 * x1 + 1) - (x0 - 1.0) * x0 * (2.0 * x0 - 1)) / 6;
+            shape.m10 += sx;
+            shape.m01 += y * n;
+            shape.m20 += sxx;
+            shape.m11 += y * sx;
+            shape.m02 += (double) y * y * n;
+        }
+        else
+        {
+            Run run = {x0, x1, (int) parent.size()};
+            parent.push_back(run.label);
+            labelArea.push_back((int) n);
+            exterior.push_back(y == 0 || x0 == 0 || x1 == width - 1);
+            runs.push_back(run);
+        }
+    }
+
+    //the background runs are 4-connected to the overlapping runs of the previous row
+    size_t p = 0;
+    for( size_t r = 0; r < runs.size(); r++ )
+    {
+        while( p < prevRuns.size() && prevRuns[p].x1 < runs[r].x0 )
+            p++;
+        for( size_t q = p; q < prevRuns.size() && prevRuns[q].x0 <= runs[r].x1; q++ )
+            unite(prevRuns[q].label, runs[r].label);
+    }
+    std::swap(prevRuns, runs);
+
+    if( rowMin != -1 )
+    {
+        extremes.push_back(cv::Point(rowMin, y));
+        if( rowMax != rowMin )
+            extremes.push_back(cv::Point(rowMax, y));
+        cv::Rect& bbox = shape.bbox;
+        if( bbox.width == 0 )
+            bbox = cv::Rect(rowMin, y, rowMax - rowMin + 1, 1);
+        else
+        {
+            int xMin = MIN(bbox.x, rowMin);
+            int xMax = MAX(bbox.x + bbox.width - 1, rowMax);
+            bbox = cv::Rect(xMin, bbox.y, xMax - xMin + 1, y - bbox.y + 1);
+        }
+    }
+
+    if( y > 0 )
+        countBoundary();
+    std::swap(above, current);
+    std::swap(current, below);
+    y++;
+}
+
+void ShapeAccumulator::finish(ShapeStats& stats)
+{
+    std::fill(below.begin(), below.end(), 0);
+    if( y > 0 )
+        countBoundary();
+    //the background of the last row touches the border
+    for( size_t r = 0; r < prevRuns.size(); r++ )
+        exterior[find(prevRuns[r].label)] = 1;
+    for( size_t l = 0; l < parent.size(); l++ )
+    {
+        if( parent[l] == (int) l && !exterior[l] )
+        {
+            shape.holes++;
+            shape.holesArea += labelArea[l];
+        }
+    }
+    shape.euler = 1 - shape.holes;
+    if( !extremes.empty() )
+        cv::convexHull(extremes, shape.hull);
+    shape.valid = shape.area > 0;
+    //the hull storage of stats is reused by the next component
+    std::swap(stats, shape);
+}
+
+/**
+ * The scan line fill of the seed at the ascending thresholds, the fill of each threshold continues from the pixels
+ * rejected by the previous ones (pending, by the first threshold they pass)
+ *
+ * The pixel accepted at the k-th threshold gets the id newVal + k, so the k-th component are the pixels of the ids
+ * newVal .. newVal + k. levelArea[k] is the area of the k-th component without the seed (as in icvFloodFill_CnIR),
+ * -1 if it is larger than maxSize, levelRect[k] is its bounding box.
+ */
+template<typename _Tp, typename _St>
+static void
+icvFloodFillLevels( cv::Mat& idImage, const cv::Mat& image, cv::Point seed, int newVal, const std::vector<long>& thresholds, int maxSize,
+		long (*distFunction)(const _Tp&, const _Tp&), std::vector<_St>* buffer, std::vector<std::vector<cv::Point> >& pending,
+		std::vector<int>& levelArea, std::vector<cv::Rect>& levelRect )
+{
+    typedef typename _St::coord_type _Ct;
+    const _Tp seedVal = image.at<_Tp>(seed.y, seed.x);
+    int levelCount = (int) thresholds.size();
+    int width = image.cols;
+    int height = image.rows;
+    _St* buffer_end = &buffer->front() + buffer->size(), *head = &buffer->front(), *tail = &buffer->front();
+
+    pending.resize(levelCount);
+    for( int k = 0; k < levelCount; k++ )
+        pending[k].clear();
+    levelArea.assign(levelCount, -1);
+    levelRect.assign(levelCount, cv::Rect());
+
+    int area = 0;
+    int XMin = seed.x, XMax = seed.x, YMin = seed.y, YMax = seed.y;
+    for( int k = 0; k < levelCount; k++ )
+    {
+        long threshold = thresholds[k];
+        int levelVal = newVal + k;
+        //the pixels of the ids newVal .. levelVal are in the component
+#define ICV_ACCEPTED( ID ) ( (unsigned)((ID) - newVal) <= (unsigned)k )
+        //the rejected pixel is continued from by the first threshold it passes
+#define ICV_REJECT( X, Y, DIST )                                \
+{                                                               \
+    int level = k + 1;                                          \
+    while( level < levelCount && (DIST) >= thresholds[level] )  \
+        level++;                                                \
+    if( level < levelCount )                                    \
+        pending[level].push_back(cv::Point(X, Y));              \
+}
+        if( k == 0 )
+            pending[0].push_back(seed);
+        for( size_t p = 0; p < pending[k].size(); p++ )
+        {
+            cv::Point start = pending[k][p];
+            int* idImg = idImage.ptr<int>(start.y);
+            const _Tp* imgPtr = image.ptr<_Tp>(start.y);
+            if( ICV_ACCEPTED(idImg[start.x]) )
+                continue;
+            //the seed is in the component regardless of the threshold and it is not counted, the other starts have passed it
+            int L = start.x, R = start.x;
+            idImg[L] = levelVal;
+            if( k > 0 )
+                area++;
+            while( ++R < width && !ICV_ACCEPTED(idImg[R]) )
+            {
+                long dist = distFunction(seedVal, imgPtr[R]);
+                if( dist >= threshold )
+                {
+                    ICV_REJECT(R, start.y, dist);
+                    break;
+                }
+                idImg[R] = levelVal;
+                area++;
+            }
+            while( --L >= 0 && !ICV_ACCEPTED(idImg[L]) )
+            {
+                long dist = distFunction(seedVal, imgPtr[L]);
+                if( dist >= threshold )
+                {
+                    ICV_REJECT(L, start.y, dist);
+                    break;
+                }
+                idImg[L] = levelVal;
+                area++;
+            }
+            R--;
+            L++;
+
+            ICV_PUSH( start.y, L, R, R + 1, R, UP );
+
+            while( head != tail )
+            {
+                int YC, PL, PR, dir;
+                ICV_POP( YC, L, R, PL, PR, dir );
+                int data[][3] =
+                {
+                    {-dir, L - 1, R + 1},
+                    {dir, L - 1, PL - 1},
+                    {dir, PR + 1, R + 1}
+                };
+
+                //the components are nested, the current and all the next ones are too big
+                if( area > maxSize )
+                    return;
+
+                if( XMax < R ) XMax = R;
+                if( XMin > L ) XMin = L;
+                if( YMax < YC ) YMax = YC;
+                if( YMin > YC ) YMin = YC;
+
+                for( int n = 0; n < 3; n++ )
+                {
+                    dir = data[n][0];
+                    int y = YC + dir;
+                    if( (unsigned)y >= (unsigned)height )
+                        continue;
+                    idImg = idImage.ptr<int>(y);
+                    imgPtr = image.ptr<_Tp>(y);
+                    int left = data[n][1];
+                    int right = data[n][2];
+
+                    for( int i = left; i <= right; i++ )
+                    {
+                        if( (unsigned)i >= (unsigned)width || ICV_ACCEPTED(idImg[i]) )
+                            continue;
+                        long dist = distFunction(seedVal, imgPtr[i]);
+                        if( dist >= threshold )
+                        {
+                            ICV_REJECT(i, y, dist);
+                            continue;
+                        }
+                        int j = i;
+                        idImg[i] = levelVal;
+                        area++;
+                        while( --j >= 0 && !ICV_ACCEPTED(idImg[j]) )
+                        {
+                            dist = distFunction(seedVal, imgPtr[j]);
+                            if( dist >= threshold )
+                            {
+                                ICV_REJECT(j, y, dist);
+                                break;
+                            }
+                            idImg[j] = levelVal;
+                            area++;
+                        }
+                        while( ++i < width && !ICV_ACCEPTED(idImg[i]) )
+                        {
+                            dist = distFunction(seedVal, imgPtr[i]);
+                            if( dist >= threshold )
+                            {
+                                ICV_REJECT(i, y, dist);
+                                break;
+                            }
+                            idImg[i] = levelVal;
+                            area++;
+                        }
+
+                        ICV_PUSH( y, j + 1, i - 1, L, R, -dir );
+                    }
+                }
+            }
+        }
+#undef ICV_REJECT
+#undef ICV_ACCEPTED
+        levelArea[k] = area;
+        levelRect[k] = cv::Rect(XMin, YMin, XMax - XMin + 1, YMax - YMin + 1);
+    }
+}
+
+template<typename _St>
+void floodFillLevels( std::vector<_St>& buffer, cv::InputOutputArray _imageId, cv::InputArray _image, cv::Point seedPoint, int channel,
+		int& compCounter, const std::vector<long>& thresholds, int maxSize, int minCompSize, cv::Mat& segmMap, const KeypointIndex& keypointIndex,
+		ShapeAccumulator* accumulator, std::vector<FloodFillLevel>& levels)
+{
+    cv::Mat imageId = _imageId.getMat();
+    cv::Mat image = _image.getMat();
+
+    if( (unsigned)seedPoint.x >= (unsigned)image.cols ||
+        (unsigned)seedPoint.y >= (unsigned)image.rows )
+        CV_Error( CV_StsOutOfRange, "Seed point is outside of image" );
+
+    if( sizeof(typename _St::coord_type) < sizeof(int) && !isCompactFFillSize(image.size()) )
+        CV_Error( CV_StsOutOfRange, "Image is too large for the compact flood fill segments, use CvFFillSegmentL buffer" );
+
+    levels.clear();
+    levels.resize(thresholds.size());
+    if( thresholds.empty() )
+        return;
+
+    std::vector<int> order(thresholds.size());
+    for( size_t i = 0; i < order.size(); i++ )
+        order[i] = (int) i;
+    std::sort(order.begin(), order.end(), [&thresholds](int a, int b) -> bool { return labs(thresholds[a]) < labs(thresholds[b]); });
+    std::vector<long> sorted(thresholds.size());
+    for( size_t i = 0; i < order.size(); i++ )
+        sorted[i] = labs(thresholds[order[i]]);
+
+    bool inverse = thresholds[0] < 0;
+    //every level has its own id, as if filled by floodFill one after another
+    int newVal = compCounter + 1;
+    compCounter += (int) thresholds.size();
+
+    buffer.clear();
+    buffer.resize( MAX( image.cols, image.rows ) * 2 );
+    std::vector<std::vector<cv::Point> > pending;
+    std::vector<int> levelArea;
+    std::vector<cv::Rect> levelRect;
+    if( image.type() == CV_8UC1 )
+    {
+        icvFloodFillLevels<uchar>(imageId, image, seedPoint, newVal, sorted, maxSize, inverse ? &ColourDistanceGrayI : &ColourDistanceGray, &buffer, pending, levelArea, levelRect);
+    }
+    else if( image.type() == CV_8UC3 )
+    {
+        switch(channel){
+        case 0:
+            icvFloodFillLevels<cv::Vec3b>(imageId, image, seedPoint, newVal, sorted, maxSize, inverse ? &ColourDistanceRGBI<0> : &ColourDistanceRGB<0>, &buffer, pending, levelArea, levelRect);
+            break;
+        case 1:
+            icvFloodFillLevels<cv::Vec3b>(imageId, image, seedPoint, newVal, sorted, maxSize, inverse ? &ColourDistanceRGBI<1> : &ColourDistanceRGB<1>, &buffer, pending, levelArea, levelRect);
+            break;
+        case 2:
+            icvFloodFillLevels<cv::Vec3b>(imageId, image, seedPoint, newVal, sorted, maxSize, inverse ? &ColourDistanceRGBI<2> : &ColourDistanceRGB<2>, &buffer, pending, levelArea, levelRect);
+            break;
+        default:
+            CV_Error( CV_StsOutOfRange, "Invalid channel!" );
+            break;
+        }
+    }
+    else
+        CV_Error( CV_StsUnsupportedFormat, "" );
+
+    for( size_t k = 0; k < sorted.size(); k++ )
+    {
+        FloodFillLevel& level = levels[order[k]];
+        if( levelArea[k] < 0 )
+        {
+            level.compNo = -2;
+            continue;
+        }
+        level.rect = levelRect[k];
+        level.area = levelArea[k];
+        if( level.area < minCompSize )
+        {
+            level.compNo = -1;
+            continue;
+        }
+
+        level.compNo = newVal + (int) k;
+        level.segmImg = cv::Mat::zeros( level.rect.height, level.rect.width, CV_8UC1 );
+        if( accumulator )
+            accumulator->begin(level.rect.width);
+        for (int y = 0; y < level.rect.height; y++  )
+        {
+            const int* rowId = imageId.ptr<int>(y + level.rect.y);
+            uchar* rowSegm = level.segmImg.ptr<uchar>(y);
+            for(int x = 0; x < level.rect.width; x++)
+            {
+                if( (unsigned)(rowId[x + level.rect.x] - newVal) <= (unsigned)k )
+                {
+                    rowSegm[x] = 255;
+#ifndef NDEBUG
+                    segmMap.at<uchar>(y + level.rect.y, x + level.rect.x) = 255;
+#endif
+                }
+            }
+            if( accumulator )
+                accumulator->addRow(rowSegm);
+            const KeypointIndex::Entry* kpEnd = keypointIndex.rowEnd(y + level.rect.y);
+            for( const KeypointIndex::Entry* kp = keypointIndex.lowerBound(y + level.rect.y, level.rect.x); kp != kpEnd && kp->x < level.rect.x + level.rect.width; kp++ )
+            {
+                if( rowSegm[kp->x - level.rect.x] != 0 )
+                    level.keypointIds.push_back(kp->id);
+            }
+        }
+        if( accumulator )
+            accumulator->finish(level.shape);
+    }
+}
+
+template void floodFillLevels<CvFFillSegment>( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageId, cv::InputArray _image, cv::Point seedPoint, int channel,
+		int& compCounter, const std::vector<long>& thresholds, int maxSize, int minCompSize, cv::Mat& segmMap, const KeypointIndex& keypointIndex,
+		ShapeAccumulator* accumulator, std::vector<FloodFillLevel>& levels);
+
+template void floodFillLevels<CvFFillSegmentL>( std::vector<CvFFillSegmentL>& buffer, cv::InputOutputArray _imageId, cv::InputArray _image, cv::Point seedPoint, int channel,
+		int& compCounter, const std::vector<long>& thresholds, int maxSize, int minCompSize, cv::Mat& segmMap, const KeypointIndex& keypointIndex,
+		ShapeAccumulator* accumulator, std::vector<FloodFillLevel>& levels);
+
 }//namespace cmp
 
 
@@ -38,25 +38,229 @@
 #include <opencv2/core/core.hpp>
 
 #include <unordered_map>
+#include <climits>
 
 namespace cmp{
 
-typedef struct CvFFillSegment
+/**
+ * The flood fill scan line segment
+ *
+ * The segment is templated on the coordinate type: the compact 16-bit
+ * segment (CvFFillSegment) is used for images up to 65535 pixels in each
+ * dimension, the 32-bit one (CvFFillSegmentL) for larger images.
+ */
+template<typename _Ct>
+struct CvFFillSegmentT
 {
-    ushort y;
-    ushort l;
-    ushort r;
-    ushort prevl;
-    ushort prevr;
+    typedef _Ct coord_type;
+
+    _Ct y;
+    _Ct l;
+    _Ct r;
+    _Ct prevl;
+    _Ct prevr;
     short dir;
+};
+
+typedef CvFFillSegmentT<ushort> CvFFillSegment;
+typedef CvFFillSegmentT<int> CvFFillSegmentL;
+
+/**
+ * @return true if the image of given size can be segmented with the compact 16-bit segments
+ */
+inline bool isCompactFFillSize(const cv::Size& size)
+{
+	return size.width <= USHRT_MAX && size.height <= USHRT_MAX;
 }
-CvFFillSegment;
 
-int floodFill( std::vector<CvFFillSegment>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel,  double scaleFactor,
-		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, std::unordered_map<int, int>& keypointHash, std::vector<int>& keypointIds,
-		bool resegment, bool gradFill, int srcCols,
+/**
+ * The keypoint positions of a pyramid level, bucketed by the image rows and sorted by the column
+ *
+ * The component scan walks the bucket of each bounding box row instead of probing every pixel.
+ */
+class KeypointIndex
+{
+public:
+
+	struct Entry
+	{
+		int x;
+		int id;
+	};
+
+	void clear()
+	{
+		pending.clear();
+		entries.clear();
+		rowStart.clear();
+	}
+
+	/**
+	 * Adds the keypoint, if replace is false, the keypoint is added only if the position is still free
+	 */
+	void add(int x, int y, int id, bool replace)
+	{
+		PendingEntry e = {y, x, id, replace};
+		pending.push_back(e);
+	}
+
+	/**
+	 * Builds the row buckets from the added keypoints
+	 */
+	void build();
+
+	/**
+	 * @return the first entry of the row y with the column >= x
+	 */
+	inline const Entry* lowerBound(int y, int x) const
+	{
+		if( y < 0 || y + 1 >= (int) rowStart.size() )
+			return NULL;
+		const Entry* begin = entries.data() + rowStart[y];
+		const Entry* end = entries.data() + rowStart[y + 1];
+		while( begin < end )
+		{
+			const Entry* mid = begin + (end - begin) / 2;
+			if( mid->x < x )
+				begin = mid + 1;
+			else
+				end = mid;
+		}
+		return begin;
+	}
+
+	/**
+	 * @return the end of the row y bucket
+	 */
+	inline const Entry* rowEnd(int y) const
+	{
+		if( y < 0 || y + 1 >= (int) rowStart.size() )
+			return NULL;
+		return entries.data() + rowStart[y + 1];
+	}
+
+private:
+
+	struct PendingEntry
+	{
+		int y;
+		int x;
+		int id;
+		bool replace;
+	};
+
+	std::vector<PendingEntry> pending;
+	std::vector<Entry> entries;
+	std::vector<int> rowStart;
+};
+
+/**
+ * The shape statistics of a component
+ *
+ * The statistics give the classifier its shape features without tracing the contours of the mask.
+ * The component is considered 8-connected and its holes 4-connected (as in cv::findContours).
+ */
+struct ShapeStats
+{
+	bool valid = false;
+	/** the bounding box of the component pixels in the mask */
+	cv::Rect bbox;
+	int area = 0;
+	/** the number of the component pixels with a 4-neighbour outside of the component */
+	int perimeter = 0;
+	int holes = 0;
+	int holesArea = 0;
+	/** the Euler number (1 - holes) */
+	int euler = 1;
+	/** the raw spatial moments */
+	double m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;
+	std::vector<cv::Point> hull;
+};
+
+/**
+ * Accumulates the ShapeStats of a component row by row while its mask is written
+ *
+ * The accumulator keeps the scratch buffers between the components, one instance is used per segmentation thread.
+ */
+class ShapeAccumulator
+{
+public:
+
+	/** starts the accumulation of a mask of the given width */
+	void begin(int width);
+
+	/** adds the next mask row, the nonzero pixels belong to the component */
+	void addRow(const uchar* row);
+
+	/** closes the mask, resolves the holes and computes the convex hull to stats */
+	void finish(ShapeStats& stats);
+
+private:
+
+	/** the background run of the row */
+	struct Run
+	{
+		int x0;
+		int x1;
+		int label;
+	};
+
+	int find(int label);
+	void unite(int label1, int label2);
+	void countBoundary();
+
+	/** the statistics of the current component */
+	ShapeStats shape;
+	int width = 0;
+	int y = 0;
+	/** the binary rows, padded by a zero pixel on both sides */
+	std::vector<uchar> above, current, below;
+	std::vector<cv::Point> extremes;
+	/** the background runs of the current and the previous row */
+	std::vector<Run> runs, prevRuns;
+	/** the union-find of the background regions */
+	std::vector<int> parent;
+	std::vector<int> labelArea;
+	std::vector<uchar> exterior;
+};
+
+template<typename _St>
+int floodFill( std::vector<_St>& buffer, cv::InputOutputArray _imageId, cv::InputOutputArray _image, cv::Point seedPoint, int channel,  double scaleFactor,
+		int& compCounter, long threshold, int maxSize, int minCompSize, cv::Mat& segmImg, cv::Mat& segmMap, cv::Rect& rect, int& area, const KeypointIndex& keypointIndex, std::vector<int>& keypointIds,
+		ShapeAccumulator* accumulator, ShapeStats* shape, bool resegment, bool gradFill,
 		cv::Scalar loDiff = cv::Scalar(), cv::Scalar upDiff = cv::Scalar());
 
+/**
+ * The seed component at one threshold of the multi-threshold flood fill
+ */
+struct FloodFillLevel
+{
+	/** the component id, -1 if the component is too small, -2 if it is too big */
+	int compNo = -1;
+	cv::Rect rect;
+	int area = 0;
+	cv::Mat segmImg;
+	std::vector<int> keypointIds;
+	ShapeStats shape;
+};
+
+/**
+ * Segments the seed at several thresholds in a single pass
+ *
+ * The components of the (non-gradient) flood fill are nested with the growing threshold,
+ * so the pixels rejected at one threshold are kept and the scan line fill just continues from them at the next one.
+ * The components are the ones of floodFill called for each threshold, each component gets its own id
+ * (the pixel keeps the id of the smallest component it is in).
+ *
+ * @param thresholds the signed thresholds (see floodFill), all of the same sign
+ * @param accumulator if not NULL, the shape statistics of the components are accumulated by it
+ * @param levels the components, in the order of thresholds
+ */
+template<typename _St>
+void floodFillLevels( std::vector<_St>& buffer, cv::InputOutputArray _imageId, cv::InputArray _image, cv::Point seedPoint, int channel,
+		int& compCounter, const std::vector<long>& thresholds, int maxSize, int minCompSize, cv::Mat& segmMap, const KeypointIndex& keypointIndex,
+		ShapeAccumulator* accumulator, std::vector<FloodFillLevel>& levels);
+
 }//namespace cmp
 
 #endif /* SRC_SEGM_FLOOD_FILL_H_ */
@@ -23,6 +23,8 @@
  */
 #include "segmentation.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <unordered_map>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -65,11 +67,152 @@ cv::Point LetterCandidate::getConvexCentroid()
 	return convexCentroid;
 }
 
-float LetterCandidate::getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, std::unordered_map<int, std::vector<std::vector<cv::Ptr<StrokeDir> > > >& keypointStrokes)
+void KeypointStrokes::store(int keypointId, const StrokeTrace& trace, bool append)
+{
+	if( keypointId >= (int) keypoints.size() )
+	{
+		keypoints.resize(keypointId + 1);
+		stamps.resize(keypointId + 1, 0);
+	}
+	Range& kp = keypoints[keypointId];
+	int strokesEnd = (int) strokes.size();
+	if( stamps[keypointId] != frame || !append )
+	{
+		kp.begin = kp.end = strokesEnd;
+		stamps[keypointId] = frame;
+	}else if( kp.end != strokesEnd )
+	{
+		//keep the keypoint strokes contiguous
+		for( int i = kp.begin; i < kp.end; i++ )
+		{
+			Range r = strokes[i];
+			strokes.push_back(r);
+		}
+		kp.begin = strokesEnd;
+	}
+	for( size_t i = 0; i < trace.size(); i++ )
+	{
+		Range r;
+		r.begin = (int) dirs.size();
+		dirs.insert(dirs.end(), trace.begin(i), trace.end(i));
+		r.end = (int) dirs.size();
+		strokes.push_back(r);
+	}
+	kp.end = (int) strokes.size();
+}
+
+/**
+ * The row span of a stroke shape in the candidate mask
+ */
+struct StrokeSpan
+{
+	int y;
+	int x0;
+	int x1;
+
+	bool operator<(const StrokeSpan& other) const
+	{
+		if( y != other.y )
+			return y < other.y;
+		return x0 < other.x0;
+	}
+};
+
+static inline void addStrokeSpan(std::vector<StrokeSpan>& spans, int y, double x0, double x1, int cols)
+{
+	StrokeSpan span = {y, MAX((int) ceil(x0), 0), MIN((int) floor(x1), cols - 1)};
+	if( span.x0 <= span.x1 )
+		spans.push_back(span);
+}
+
+/**
+ * restricts the interval of u to the solutions of lo <= a * u + c <= hi
+ */
+static inline void constrainSpan(double& u0, double& u1, double a, double c, double lo, double hi)
+{
+	if( fabs(a) < 1e-9 )
+	{
+		if( c < lo || c > hi )
+		{
+			u0 = 1;
+			u1 = 0;
+		}
+		return;
+	}
+	double v0 = (lo - c) / a;
+	double v1 = (hi - c) / a;
+	u0 = MAX(u0, MIN(v0, v1));
+	u1 = MIN(u1, MAX(v0, v1));
+}
+
+/**
+ * adds the row spans of the disc
+ */
+static void addDiscSpans(std::vector<StrokeSpan>& spans, cv::Point2d c, double r, int rows, int cols)
+{
+	int y0 = MAX((int) ceil(c.y - r), 0);
+	int y1 = MIN((int) floor(c.y + r), rows - 1);
+	for( int y = y0; y <= y1; y++ )
+	{
+		double h = r * r - (y - c.y) * (y - c.y);
+		if( h < 0 )
+			continue;
+		h = sqrt(h);
+		addStrokeSpan(spans, y, c.x - h, c.x + h, cols);
+	}
+}
+
+/**
+ * adds the row spans of the thick line (the segment a-b swept by the disc of radius r)
+ */
+static void addCapsuleSpans(std::vector<StrokeSpan>& spans, cv::Point2d a, cv::Point2d b, double r, int rows, int cols)
+{
+	cv::Point2d d = b - a;
+	double len2 = d.x * d.x + d.y * d.y;
+	double len = sqrt(len2);
+	int y0 = MAX((int) ceil(MIN(a.y, b.y) - r), 0);
+	int y1 = MIN((int) floor(MAX(a.y, b.y) + r), rows - 1);
+	for( int y = y0; y <= y1; y++ )
+	{
+		//the capsule is convex, so its row section is the hull of the sections of the end discs and the band
+		double lo = DBL_MAX, hi = -DBL_MAX;
+		double ha = r * r - (y - a.y) * (y - a.y);
+		if( ha >= 0 )
+		{
+			ha = sqrt(ha);
+			lo = MIN(lo, a.x - ha);
+			hi = MAX(hi, a.x + ha);
+		}
+		double hb = r * r - (y - b.y) * (y - b.y);
+		if( hb >= 0 )
+		{
+			hb = sqrt(hb);
+			lo = MIN(lo, b.x - hb);
+			hi = MAX(hi, b.x + hb);
+		}
+		if( len2 > 0 )
+		{
+			double u0 = -DBL_MAX, u1 = DBL_MAX;
+			double dy = y - a.y;
+			constrainSpan(u0, u1, d.x, dy * d.y, 0, len2);
+			constrainSpan(u0, u1, d.y, -dy * d.x, -r * len, r * len);
+			if( u0 <= u1 )
+			{
+				lo = MIN(lo, a.x + u0);
+				hi = MAX(hi, a.x + u1);
+			}
+		}
+		if( lo <= hi )
+			addStrokeSpan(spans, y, lo, hi, cols);
+	}
+}
+
+float LetterCandidate::getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, const KeypointStrokes& keypointStrokes)
 {
 	if( strokeAreaRatio != -1)
 		return strokeAreaRatio;
-	cv::Mat tmp = cv::Mat::zeros(mask.rows, mask.cols, CV_8UC1);
+	//the stroke shapes are intersected with the mask rows directly, without rasterizing them
+	std::vector<StrokeSpan> spans;
 	for( auto kpid : keypointIds )
 	{
 		cmp::FastKeyPoint& kp = img1_keypoints[kpid];
@@ -79,42 +222,57 @@ float LetterCandidate::getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_k
 			continue;
 		int radius = 2 / scales[kp.octave] / this->scaleFactor;
 		double sf = 1.0 /  scales[kp.octave];
-		cv::Scalar color( 255, 255, 255 );
 		if( kp.count == 5)
 		{
-			cv::circle(tmp, cv::Point((kp.pt.x - bbox.x) / this->scaleFactor, (kp.pt.y - bbox.y) / this->scaleFactor), radius, color, -1);
+			cv::Point center((int) ((kp.pt.x - bbox.x) / this->scaleFactor), (int) ((kp.pt.y - bbox.y) / this->scaleFactor));
+			addDiscSpans(spans, center, radius, mask.rows, mask.cols);
 		}
 		else
 		{
-			std::vector<std::vector<cv::Ptr<StrokeDir> > >& storkeDirections = keypointStrokes[kpid];
-			for( auto strokes : storkeDirections  )
+			for( size_t s = 0; s < keypointStrokes.size(kpid); s++ )
 			{
 				int thickness = kp.count / scales[kp.octave] / this->scaleFactor;
 				thickness = MAX(1, thickness);
 				thickness = MIN(255, thickness);
-				for( auto sd : strokes)
+				for( const StrokeDir* sd = keypointStrokes.begin(kpid, s); sd != keypointStrokes.end(kpid, s); sd++ )
 				{
-
-					cv::line( tmp,
-							cv::Point(roundf((sd->center.x * sf - bbox.x) / this->scaleFactor), roundf((sd->center.y * sf - bbox.y) / this->scaleFactor)) ,
-							cv::Point(roundf((sd->direction.x * sf - bbox.x) / this->scaleFactor), roundf((sd->direction.y * sf - bbox.y) / this->scaleFactor)),
-							color, thickness );
+					cv::Point2d p0(roundf((sd->center.x * sf - bbox.x) / this->scaleFactor), roundf((sd->center.y * sf - bbox.y) / this->scaleFactor));
+					cv::Point2d p1(roundf((sd->direction.x * sf - bbox.x) / this->scaleFactor), roundf((sd->direction.y * sf - bbox.y) / this->scaleFactor));
+					addCapsuleSpans(spans, p0, p1, thickness / 2.0, mask.rows, mask.cols);
 				}
 			}
 		}
 
 	}
 
-	cv::Mat strokeArea;
-	cv::bitwise_and( tmp, mask, strokeArea);
-	int pixels = countNonZero(strokeArea);
+	std::sort(spans.begin(), spans.end());
+	int pixels = 0;
+	for( size_t i = 0; i < spans.size(); )
+	{
+		//merge the overlapping spans of the row and count the mask pixels under them
+		int y = spans[i].y;
+		int x0 = spans[i].x0;
+		int x1 = spans[i].x1;
+		const uchar* maskRow = mask.ptr<uchar>(y);
+		for( i++; ; i++ )
+		{
+			if( i < spans.size() && spans[i].y == y && spans[i].x0 <= x1 + 1 )
+			{
+				x1 = MAX(x1, spans[i].x1);
+				continue;
+			}
+			for( int x = x0; x <= x1; x++ )
+			{
+				if( maskRow[x] != 0 )
+					pixels++;
+			}
+			if( i >= spans.size() || spans[i].y != y )
+				break;
+			x0 = spans[i].x0;
+			x1 = spans[i].x1;
+		}
+	}
 	strokeAreaRatio = pixels / (float) countNonZero(mask);
-	/*
-	cv::imshow("mask", mask);
-	cv::imshow("tmp", tmp);
-	cv::imshow("strokeArea", strokeArea);
-	cv::waitKey(0);
-	*/
 	return strokeAreaRatio;
 
 }
@@ -187,7 +345,7 @@ cv::Mat LetterCandidate::createChildsImage(const cv::Mat& image, std::vector<Let
 	cv::Mat tmp = cv::Mat::zeros(image.rows, image.cols, CV_8UC1);
 
 
-	for( std::set<int>::iterator it = childs.begin(); it != childs.end(); it++ )
+	for( IdSet::iterator it = childs.begin(); it != childs.end(); it++ )
 	{
 		LetterCandidate& ref1 =  letterCandidates[*it];
 		cv::Rect rootRect = cv::Rect(ref1.bbox.x, ref1.bbox.y,  ref1.bbox.width, ref1.bbox.height);
@@ -230,7 +388,7 @@ cv::Mat LetterCandidate::createChildsImage(const cv::Mat& image, std::vector<Let
 	return tmp;
 }
 
-cv::Mat LetterCandidate::generateStrokeWidthMap(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, std::unordered_map<int, std::vector<std::vector<cv::Ptr<StrokeDir> > > >& keypointStrokes)
+cv::Mat LetterCandidate::generateStrokeWidthMap(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, const KeypointStrokes& keypointStrokes)
 {
 	cv::Mat tmp = this->mask.clone();
 	cv::cvtColor(tmp, tmp, cv::COLOR_GRAY2BGR);
@@ -250,13 +408,12 @@ cv::Mat LetterCandidate::generateStrokeWidthMap(std::vector<cmp::FastKeyPoint>&
 		}
 		else
 		{
-			std::vector<std::vector<cv::Ptr<StrokeDir> > >& storkeDirections = keypointStrokes[kpid];
-			for( auto strokes : storkeDirections  )
+			for( size_t s = 0; s < keypointStrokes.size(kpid); s++ )
 			{
 				int thickness = kp.count / scales[kp.octave] / this->scaleFactor;
 				thickness = MAX(1, thickness);
 				thickness = MIN(255, thickness);
-				for( auto sd : strokes)
+				for( const StrokeDir* sd = keypointStrokes.begin(kpid, s); sd != keypointStrokes.end(kpid, s); sd++ )
 				{
 
 					cv::line( tmp, cv::Point(roundf((sd->center.x * sf - bbox.x) / this->scaleFactor), roundf((sd->center.y * sf - bbox.y) / this->scaleFactor)) ,
@@ -26,6 +26,7 @@
 
 #include <opencv2/core/core.hpp>
 #include <set>
+#include <algorithm>
 #include <iostream>
 #include <assert.h>
 
@@ -48,10 +49,313 @@ public:
 	long threshold;
 	int idx;
 
-	StrokeDir(int idx, long threshold,  cv::Point center = cv::Point(), cv::Point direction = cv::Point()) : idx(idx), center(center), direction(direction), threshold(threshold)
+	StrokeDir() : threshold(0), idx(0)
 	{
 
 	}
+
+	StrokeDir(int idx, long threshold,  cv::Point center = cv::Point(), cv::Point direction = cv::Point()) : center(center), direction(direction), threshold(threshold), idx(idx)
+	{
+
+	}
+};
+
+/**
+ * The strokes traced from a single keypoint
+ *
+ * The stroke steps are kept in one flat array, the stroke i spans dirs[strokeStart[i]] to the start of the next stroke.
+ */
+class StrokeTrace {
+public:
+
+	inline void clear()
+	{
+		dirs.clear();
+		strokeStart.clear();
+	}
+
+	/** starts a new stroke, the next pushed steps belong to it */
+	inline void beginStroke()
+	{
+		strokeStart.push_back((int) dirs.size());
+	}
+
+	/** appends the step to the last stroke */
+	inline void push(const StrokeDir& dir)
+	{
+		dirs.push_back(dir);
+	}
+
+	/** @return the number of strokes */
+	inline size_t size() const
+	{
+		return strokeStart.size();
+	}
+
+	inline const StrokeDir* begin(size_t stroke) const
+	{
+		return dirs.data() + strokeStart[stroke];
+	}
+
+	inline const StrokeDir* end(size_t stroke) const
+	{
+		return dirs.data() + (stroke + 1 < strokeStart.size() ? strokeStart[stroke + 1] : dirs.size());
+	}
+
+	/** @return the number of steps of the stroke */
+	inline size_t length(size_t stroke) const
+	{
+		return end(stroke) - begin(stroke);
+	}
+
+	std::vector<StrokeDir> dirs;
+	std::vector<int> strokeStart;
+
+	/** the working stack of the tracing, kept to reuse its storage */
+	std::vector<StrokeDir> stack;
+};
+
+/**
+ * The strokes of all keypoints of the processed image
+ *
+ * The records of all keypoints share flat arrays which are reused from image to image,
+ * clear() releases the whole image in constant time.
+ */
+class KeypointStrokes {
+public:
+
+	inline void clear()
+	{
+		dirs.clear();
+		strokes.clear();
+		frame++;
+	}
+
+	/**
+	 * Stores the keypoint strokes
+	 *
+	 * @param append if true, the strokes are added to the keypoint strokes stored before, otherwise they replace them
+	 */
+	void store(int keypointId, const StrokeTrace& trace, bool append);
+
+	inline bool has(int keypointId) const
+	{
+		return keypointId >= 0 && keypointId < (int) stamps.size() && stamps[keypointId] == frame;
+	}
+
+	/** @return the number of strokes of the keypoint */
+	inline size_t size(int keypointId) const
+	{
+		if( !has(keypointId) )
+			return 0;
+		return keypoints[keypointId].end - keypoints[keypointId].begin;
+	}
+
+	inline const StrokeDir* begin(int keypointId, size_t stroke) const
+	{
+		return dirs.data() + strokes[keypoints[keypointId].begin + stroke].begin;
+	}
+
+	inline const StrokeDir* end(int keypointId, size_t stroke) const
+	{
+		return dirs.data() + strokes[keypoints[keypointId].begin + stroke].end;
+	}
+
+private:
+
+	struct Range
+	{
+		int begin;
+		int end;
+	};
+
+	std::vector<StrokeDir> dirs;
+	/** the strokes, ranges in dirs */
+	std::vector<Range> strokes;
+	/** the keypoint strokes, ranges in strokes, valid if the keypoint stamp is the current frame */
+	std::vector<Range> keypoints;
+	std::vector<int> stamps;
+	int frame = 1;
+};
+
+/**
+ * The sorted set of the component ids
+ *
+ * The ids are kept in a sorted array, up to INLINE_CAPACITY of them without the heap allocation.
+ * The iteration order is the one of std::set<int>, the iterators are invalidated by the modifications.
+ */
+class IdSet {
+public:
+
+	typedef const int* iterator;
+	typedef const int* const_iterator;
+
+	IdSet() : ids(inlineIds), length(0), capacity(INLINE_CAPACITY)
+	{
+
+	}
+
+	IdSet(const IdSet& other) : IdSet()
+	{
+		*this = other;
+	}
+
+	IdSet(IdSet&& other) noexcept : IdSet()
+	{
+		moveFrom(other);
+	}
+
+	~IdSet()
+	{
+		release();
+	}
+
+	IdSet& operator=(const IdSet& other)
+	{
+		if( this != &other )
+		{
+			length = 0;
+			reserve(other.length);
+			std::copy(other.ids, other.ids + other.length, ids);
+			length = other.length;
+		}
+		return *this;
+	}
+
+	IdSet& operator=(IdSet&& other) noexcept
+	{
+		if( this != &other )
+		{
+			release();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	inline const_iterator begin() const
+	{
+		return ids;
+	}
+
+	inline const_iterator end() const
+	{
+		return ids + length;
+	}
+
+	inline size_t size() const
+	{
+		return length;
+	}
+
+	inline bool empty() const
+	{
+		return length == 0;
+	}
+
+	/** removes the ids, the storage is kept */
+	inline void clear()
+	{
+		length = 0;
+	}
+
+	inline const_iterator find(int id) const
+	{
+		const int* it = std::lower_bound(ids, ids + length, id);
+		return it != end() && *it == id ? it : end();
+	}
+
+	inline size_t count(int id) const
+	{
+		return find(id) != end() ? 1 : 0;
+	}
+
+	/**
+	 * @return true if the id was not in the set
+	 */
+	inline bool insert(int id)
+	{
+		//the ids are mostly inserted in the ascending order
+		if( length == 0 || ids[length - 1] < id )
+		{
+			reserve(length + 1);
+			ids[length++] = id;
+			return true;
+		}
+		size_t pos = std::lower_bound(ids, ids + length, id) - ids;
+		if( ids[pos] == id )
+			return false;
+		reserve(length + 1);
+		std::copy_backward(ids + pos, ids + length, ids + length + 1);
+		ids[pos] = id;
+		length++;
+		return true;
+	}
+
+	template<typename InputIterator>
+	void insert(InputIterator first, InputIterator last)
+	{
+		for( ; first != last; ++first )
+			insert(*first);
+	}
+
+	/**
+	 * @return the number of the removed ids
+	 */
+	size_t erase(int id)
+	{
+		int* it = std::lower_bound(ids, ids + length, id);
+		if( it == ids + length || *it != id )
+			return 0;
+		std::copy(it + 1, ids + length, it);
+		length--;
+		return 1;
+	}
+
+	void reserve(size_t size)
+	{
+		if( size <= capacity )
+			return;
+		size_t newCapacity = MAX(size, capacity * 2);
+		int* data = new int[newCapacity];
+		std::copy(ids, ids + length, data);
+		release();
+		ids = data;
+		capacity = newCapacity;
+	}
+
+private:
+
+	static const size_t INLINE_CAPACITY = 8;
+
+	inline void release()
+	{
+		if( ids != inlineIds )
+			delete[] ids;
+		ids = inlineIds;
+		capacity = INLINE_CAPACITY;
+	}
+
+	inline void moveFrom(IdSet& other)
+	{
+		if( other.ids != other.inlineIds )
+		{
+			ids = other.ids;
+			capacity = other.capacity;
+		}
+		else
+		{
+			std::copy(other.ids, other.ids + other.length, inlineIds);
+		}
+		length = other.length;
+		other.ids = other.inlineIds;
+		other.capacity = INLINE_CAPACITY;
+		other.length = 0;
+	}
+
+	int* ids;
+	size_t length;
+	size_t capacity;
+	int inlineIds[INLINE_CAPACITY];
 };
 
 class LetterCandidate{
@@ -82,10 +386,7 @@ public:
 	}
 
 	void addNeibour(int refComp){
-		if(neibours.find(refComp) == neibours.end())
-		{
-			neibours.insert(refComp);
-		}
+		neibours.insert(refComp);
 	}
 
 	void addChild(int refComp, std::vector<LetterCandidate>& letterCandidates, int refComp2){
@@ -102,7 +403,7 @@ public:
 
 	cv::Mat createChildsImage(const cv::Mat& image, std::vector<LetterCandidate>& letterCandidates);
 
-	cv::Mat generateStrokeWidthMap(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, std::unordered_map<int, std::vector<std::vector<cv::Ptr<StrokeDir> > > >& keypointStrokes);
+	cv::Mat generateStrokeWidthMap(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, const KeypointStrokes& keypointStrokes);
 
 	cv::Mat generateKeypointImg(const cv::Mat& img, std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels);
 
@@ -115,7 +416,7 @@ public:
 		return strokeAreaRatio;
 	}
 
-	float getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, std::unordered_map<int, std::vector<std::vector<cv::Ptr<StrokeDir> > > >& keypointStrokes);
+	float getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::vector<double>& scales, const KeypointStrokes& keypointStrokes);
 
 	float getStrokeAreaRatio(std::vector<cmp::FastKeyPoint>& img1_keypoints, std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels);
 
@@ -152,9 +453,9 @@ public:
 	std::vector<std::vector<cv::Point> > contoursAp;
 	std::vector<cv::Vec4i> hierarchy;
 	std::vector<cv::Point> cHullPoints;
-	std::set<int> parents;
-	std::set<int> childs;
-	std::set<int> neibours;
+	IdSet parents;
+	IdSet childs;
+	IdSet neibours;
 	std::vector<int> duplicates;
 	int duplicate;
 
@@ -190,6 +491,9 @@ public:
 
 	cv::Mat featureVector;
 
+	/** the shape statistics of the mask, valid if accumulated by the segmentation */
+	ShapeStats shape;
+
 private:
 
 	cv::Point centroid;
@@ -0,0 +1,90 @@
+/*
+ * test_geometry.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#include <iostream>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "geometry.h"
+
+using namespace cmp;
+
+/**
+ * @return the area of the convex polygon given by its unordered points
+ */
+static double convexArea( const std::vector<cv::Point2f>& points )
+{
+	if( points.size() < 3 )
+		return 0;
+	std::vector<cv::Point2f> hull;
+	cv::convexHull(points, hull);
+	return cv::contourArea(hull);
+}
+
+struct IntersectionCase
+{
+	cv::RotatedRect rect1;
+	cv::RotatedRect rect2;
+	int type;
+	double area;
+};
+
+/**
+ * The intersection types and areas of rotatedRectangleIntersection and rotatedRectangleIntersectionArea
+ * on the aligned, touching, enclosed, separated and rotated rectangles, in both orders
+ */
+static bool testRectangleIntersection()
+{
+	const IntersectionCase cases[] = {
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 6), 0), cv::RotatedRect(cv::Point2f(14, 12), cv::Size2f(10, 6), 0), INTERSECT_PARTIAL, 24 },
+		//the same rectangle rotated by 90 degrees with the swapped sides
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(6, 10), 90), cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 6), 0), INTERSECT_FULL, 60 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(6, 10), 90), cv::RotatedRect(cv::Point2f(12, 10), cv::Size2f(8, 4), 0), INTERSECT_PARTIAL, 28 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 10), 0), cv::RotatedRect(cv::Point2f(20, 10), cv::Size2f(10, 10), 0), INTERSECT_PARTIAL, 0 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 10), 0), cv::RotatedRect(cv::Point2f(20, 20), cv::Size2f(10, 10), 0), INTERSECT_PARTIAL, 0 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 10), 0), cv::RotatedRect(cv::Point2f(30, 10), cv::Size2f(10, 10), 0), INTERSECT_NONE, 0 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(20, 20), 0), cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(4, 4), 0), INTERSECT_FULL, 16 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(20, 20), 0), cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(4, 4), 30), INTERSECT_FULL, 16 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 4), 30), cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 4), 30), INTERSECT_FULL, 40 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 4), 30), cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(4, 10), 120), INTERSECT_FULL, 40 },
+		{ cv::RotatedRect(cv::Point2f(10, 10), cv::Size2f(10, 4), 30), cv::RotatedRect(cv::Point2f(12, 11), cv::Size2f(10, 4), -20), INTERSECT_PARTIAL, 19.7041 },
+		{ cv::RotatedRect(cv::Point2f(0, 0), cv::Size2f(10, 2), 45), cv::RotatedRect(cv::Point2f(4, -4), cv::Size2f(10, 2), 45), INTERSECT_NONE, 0 },
+		{ cv::RotatedRect(cv::Point2f(0, 0), cv::Size2f(10, 2), 45), cv::RotatedRect(cv::Point2f(1, -1), cv::Size2f(10, 2), 45), INTERSECT_PARTIAL, 5.8579 }
+	};
+	bool valid = true;
+	for( size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++ )
+	{
+		for( int order = 0; order < 2; order++ )
+		{
+			const cv::RotatedRect& rect1 = order == 0 ? cases[i].rect1 : cases[i].rect2;
+			const cv::RotatedRect& rect2 = order == 0 ? cases[i].rect2 : cases[i].rect1;
+			double eps = 1e-3 * (1 + cases[i].area);
+
+			std::vector<cv::Point2f> intersection;
+			int type = rotatedRectangleIntersection(rect1, rect2, intersection);
+			int areaType;
+			float area = rotatedRectangleIntersectionArea(rect1, rect2, &areaType);
+			if( type != cases[i].type || areaType != cases[i].type || fabs(convexArea(intersection) - cases[i].area) > eps || fabs(area - cases[i].area) > eps )
+			{
+				std::cerr << "Rectangles " << i << " (order " << order << "): type " << type << ", " << areaType << " area " << convexArea(intersection) << ", " << area
+						<< " expected type " << cases[i].type << " area " << cases[i].area << std::endl;
+				valid = false;
+			}
+		}
+	}
+	return valid;
+}
+
+int main(int argc, char **argv)
+{
+	bool valid = true;
+	if( !testRectangleIntersection() )
+	{
+		std::cerr << "Rectangle intersection: failed" << std::endl;
+		valid = false;
+	}
+	return valid ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+/*
+ * test_hough.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#include <iostream>
+
+#include "HoughTLDetector.h"
+
+using namespace cmp;
+
+/**
+ * Adds the row of the letters starting at (x, y) slanted by the angle (in radians)
+ */
+static void addRow(std::vector<LetterCandidate>& letters, int x, int y, double angle, int count)
+{
+	const int height = 20;
+	const int width = 14;
+	const int step = 22;
+	for( int i = 0; i < count; i++ )
+	{
+		int cx = cvRound(x + i * step * cos(angle));
+		int cy = cvRound(y + i * step * sin(angle));
+		letters.push_back(LetterCandidate());
+		letters.back().bbox = cv::Rect(cx - width / 2, cy - height / 2, width, height);
+		letters.back().quality = 0.9f;
+		letters.back().keyPoint.type = 0;
+	}
+}
+
+/**
+ * @return the lines of the letters, the time of the detection is added to time
+ */
+static std::vector<LineGroup> findLines(std::vector<LetterCandidate>& letters, const cv::Mat& image, bool coarseToFine, int64& time)
+{
+	HoughTLDetector detector;
+	detector.coarseToFine = coarseToFine;
+	std::vector<LineGroup> lineGroups;
+	int64 startTime = cv::getTickCount();
+	detector.findTextLines(letters, image, 20, lineGroups, 0);
+	time += cv::getTickCount() - startTime;
+	return lineGroups;
+}
+
+/**
+ * The coarse to fine voting finds the rows of letters slanted by 15, 20 and 85 degrees (the last one is refined
+ * below the zero angle and wrapped), all the row letters are on one line with the angle within the fine bin
+ */
+static bool testSlantedLines()
+{
+	const int count = 12;
+	const double angles[] = {15, 20, 85};
+	cv::Mat image = cv::Mat::zeros(480, 640, CV_8UC1);
+	bool valid = true;
+	for( size_t a = 0; a < sizeof(angles) / sizeof(angles[0]); a++ )
+	{
+		double angle = angles[a] * M_PI / 180;
+		std::vector<LetterCandidate> letters;
+		addRow(letters, 100, 100, angle, count);
+
+		size_t bestSize[2] = {0, 0};
+		double bestTheta[2] = {0, 0};
+		for( int mode = 0; mode < 2; mode++ )
+		{
+			int64 time = 0;
+			std::vector<LineGroup> lineGroups = findLines(letters, image, mode == 1, time);
+			for( size_t i = 0; i < lineGroups.size(); i++ )
+			{
+				if( lineGroups[i].theta < 0 || lineGroups[i].theta >= M_PI )
+				{
+					std::cerr << "Line angle " << lineGroups[i].theta << " out of [0, pi)" << std::endl;
+					valid = false;
+				}
+				if( lineGroups[i].regionIds.size() > bestSize[mode] )
+				{
+					bestSize[mode] = lineGroups[i].regionIds.size();
+					bestTheta[mode] = lineGroups[i].theta;
+				}
+			}
+		}
+		//the line normal is perpendicular to the row
+		double normal = angle + M_PI_2;
+		double fineStep = M_PI / 64;
+		if( bestSize[1] < bestSize[0] || bestSize[1] != (size_t) count || fabs(bestTheta[1] - normal) > fineStep )
+		{
+			std::cerr << "Row slanted by " << angles[a] << ": " << bestSize[1] << " letters, angle " << bestTheta[1] * 180 / M_PI
+					<< " (the 16 bins voting: " << bestSize[0] << " letters)" << std::endl;
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+/**
+ * Reports the time of the coarse to fine voting and the 16 angle bins one on the page of the slanted rows,
+ * with the count of the found lines and of the lines of at least the half of a row
+ */
+static void reportSpeed()
+{
+	cv::Mat image = cv::Mat::zeros(1200, 1600, CV_8UC1);
+	std::vector<LetterCandidate> letters;
+	const int rows = 20;
+	const int count = 30;
+	for( int row = 0; row < rows; row++ )
+		addRow(letters, 60, 100 + row * 50, 10 * M_PI / 180, count);
+
+	const int repeats = 20;
+	int64 time[2] = {0, 0};
+	size_t lines[2] = {0, 0};
+	size_t rowLines[2] = {0, 0};
+	for( int i = 0; i < repeats; i++ )
+	{
+		for( int mode = 0; mode < 2; mode++ )
+		{
+			std::vector<LineGroup> lineGroups = findLines(letters, image, mode == 1, time[mode]);
+			lines[mode] = lineGroups.size();
+			rowLines[mode] = 0;
+			for( size_t l = 0; l < lineGroups.size(); l++ )
+			{
+				if( lineGroups[l].regionIds.size() * 2 >= (size_t) count )
+					rowLines[mode]++;
+			}
+		}
+	}
+	for( int mode = 0; mode < 2; mode++ )
+	{
+		std::cout << (mode == 1 ? "Coarse to fine voting: " : "16 angle bins voting: ") << time[mode] / cv::getTickFrequency() * 1000 / repeats
+				<< " ms, " << lines[mode] << " lines (" << rowLines[mode] << " of at least " << count / 2 << " letters) of "
+				<< rows << " rows" << std::endl;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool valid = true;
+	if( !testSlantedLines() )
+	{
+		std::cerr << "Slanted lines: failed" << std::endl;
+		valid = false;
+	}
+	reportSpeed();
+	return valid ? 0 : 1;
+}
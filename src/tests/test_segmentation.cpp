@@ -0,0 +1,121 @@
+/*
+ * test_segmentation.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#include <iostream>
+#include <unordered_map>
+
+#include "FTPyramid.hpp"
+#include "CharClassifier.h"
+#include "Segmenter.h"
+#include "test_utils.h"
+
+using namespace cmp;
+
+/**
+ * The stroke area ratio of the strokes rasterized into the mask sized image (the computation replaced by the row spans)
+ */
+static float rasterStrokeAreaRatio(LetterCandidate& letter, std::vector<FastKeyPoint>& keypoints, std::vector<double>& scales, const KeypointStrokes& keypointStrokes)
+{
+	cv::Mat tmp = cv::Mat::zeros(letter.mask.rows, letter.mask.cols, CV_8UC1);
+	cv::Scalar color( 255, 255, 255 );
+	for( auto kpid : letter.keypointIds )
+	{
+		FastKeyPoint& kp = keypoints[kpid];
+		if( kp.type != letter.keyPoint.type )
+			continue;
+		if( abs(kp.octave - letter.keyPoint.octave) > 2 )
+			continue;
+		int radius = 2 / scales[kp.octave] / letter.scaleFactor;
+		double sf = 1.0 /  scales[kp.octave];
+		if( kp.count == 5)
+		{
+			cv::circle(tmp, cv::Point((kp.pt.x - letter.bbox.x) / letter.scaleFactor, (kp.pt.y - letter.bbox.y) / letter.scaleFactor), radius, color, -1);
+			continue;
+		}
+		for( size_t s = 0; s < keypointStrokes.size(kpid); s++ )
+		{
+			int thickness = kp.count / scales[kp.octave] / letter.scaleFactor;
+			thickness = MAX(1, thickness);
+			thickness = MIN(255, thickness);
+			for( const StrokeDir* sd = keypointStrokes.begin(kpid, s); sd != keypointStrokes.end(kpid, s); sd++ )
+			{
+				cv::line( tmp,
+						cv::Point(roundf((sd->center.x * sf - letter.bbox.x) / letter.scaleFactor), roundf((sd->center.y * sf - letter.bbox.y) / letter.scaleFactor)) ,
+						cv::Point(roundf((sd->direction.x * sf - letter.bbox.x) / letter.scaleFactor), roundf((sd->direction.y * sf - letter.bbox.y) / letter.scaleFactor)),
+						color, thickness );
+			}
+		}
+	}
+	cv::Mat strokeArea;
+	cv::bitwise_and( tmp, letter.mask, strokeArea);
+	return countNonZero(strokeArea) / (float) countNonZero(letter.mask);
+}
+
+/**
+ * The row spans stroke area ratio (the feature 0 of the classifier) is the one of the rasterized strokes
+ *
+ * The span shapes are the exact discs and capsules, the edge pixels of the rasterized ones differ,
+ * so the ratio may differ by 0.1 on a single component (a one pixel ring of a thin stroke) and by 0.02 on average.
+ */
+static bool testStrokeAreaRatio(cv::Mat& img)
+{
+	cv::Ptr<FTPyr> ftDetector = cv::Ptr<FTPyr> (new FTPyr(3000, 1.6f, -1, 12, 3, 9, 11, false, false, false));
+	std::vector<FastKeyPoint> keypoints;
+	std::unordered_multimap<int, std::pair<int, int> > keypointsPixels;
+	ftDetector->detect(img, keypoints, keypointsPixels);
+	//the stroke spans are used when the keypoints have no segmented pixels
+	keypointsPixels.clear();
+
+	cv::Ptr<CharClassifier> charClassifier = cv::Ptr<CharClassifier> (new CvBoostCharClassifier(FT_MODEL_FILE));
+	PyramidSegmenter segmenter(ftDetector, charClassifier);
+	std::vector<LetterCandidate*> letters;
+	segmenter.getLetterCandidates(img, keypoints, keypointsPixels, letters);
+	std::vector<double> scales = ftDetector->getScales();
+
+	const float maxDiff = 0.1f;
+	const float maxMeanDiff = 0.02f;
+	std::vector<LetterCandidate>& candidates = static_cast<Segmenter&>(segmenter).getLetterCandidates();
+	double diffSum = 0;
+	int count = 0;
+	for( size_t i = 0; i < candidates.size(); i++ )
+	{
+		LetterCandidate& letter = candidates[i];
+		if( letter.duplicate != -1 || letter.getStrokeAreaRatioP() == -1 )
+			continue;
+		float raster = rasterStrokeAreaRatio(letter, keypoints, scales, segmenter.keypointStrokes);
+		float diff = fabs(letter.getStrokeAreaRatioP() - raster);
+		if( diff > maxDiff )
+		{
+			std::cerr << "Candidate " << i << " stroke area ratio: " << letter.getStrokeAreaRatioP() << " spans, " << raster << " raster" << std::endl;
+			return false;
+		}
+		diffSum += diff;
+		count++;
+	}
+	if( count == 0 )
+	{
+		std::cerr << "No stroke area ratio computed" << std::endl;
+		return false;
+	}
+	if( diffSum / count > maxMeanDiff )
+	{
+		std::cerr << "Mean stroke area ratio difference: " << diffSum / count << " of " << count << " candidates" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	cv::Mat img = makeTextImage();
+	bool valid = true;
+	if( !testStrokeAreaRatio(img) )
+	{
+		std::cerr << "Stroke area ratio: failed" << std::endl;
+		valid = false;
+	}
+	return valid ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/*
+ * test_segmenter.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#include "FTPyramid.hpp"
+#include "CharClassifier.h"
+#include "Segmenter.h"
+#include "segm/flood_fill.h"
+#include "test_utils.h"
+
+using namespace cmp;
+
+/**
+ * Segments the letter candidates of the image keypoints
+ */
+static std::vector<LetterCandidate>& segment(Segmenter& segmenter, cv::Mat& img, const std::vector<FastKeyPoint>& keypoints,
+		std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels)
+{
+	//the segmentation sorts and marks the keypoints, each run gets its copy
+	std::vector<FastKeyPoint> runKeypoints = keypoints;
+	std::vector<LetterCandidate*> letters;
+	segmenter.getLetterCandidates(img, runKeypoints, keypointsPixels, letters);
+	return segmenter.getLetterCandidates();
+}
+
+static bool sameIds(const IdSet& a, const IdSet& b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+static bool sameMask(const cv::Mat& a, const cv::Mat& b)
+{
+	if( a.size() != b.size() || a.type() != b.type() )
+		return false;
+	return a.empty() || cv::countNonZero(a != b) == 0;
+}
+
+static bool sameCandidates(std::vector<LetterCandidate>& serial, std::vector<LetterCandidate>& parallel)
+{
+	if( serial.size() != parallel.size() )
+	{
+		std::cerr << "Candidates count: " << serial.size() << " serial, " << parallel.size() << " parallel" << std::endl;
+		return false;
+	}
+	for( size_t i = 0; i < serial.size(); i++ )
+	{
+		LetterCandidate& a = serial[i];
+		LetterCandidate& b = parallel[i];
+		if( a.bbox != b.bbox || a.area != b.area || a.duplicate != b.duplicate || a.keypointIds != b.keypointIds
+				|| a.quality != b.quality || !sameIds(a.parents, b.parents) || !sameIds(a.childs, b.childs) || !sameMask(a.mask, b.mask) )
+		{
+			std::cerr << "Candidate " << i << " differs: " << a.bbox << " area " << a.area << " quality " << a.quality << " serial, "
+					<< b.bbox << " area " << b.area << " quality " << b.quality << " parallel" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool sameLevel(const FloodFillLevel& level, int compNo, const cv::Rect& rect, int area, const cv::Mat& segmImg, const std::vector<int>& keypointIds)
+{
+	if( (level.compNo >= 0) != (compNo >= 0) || (compNo < 0 && level.compNo != compNo) )
+		return false;
+	if( compNo < 0 )
+		return true;
+	return level.rect == rect && level.area == area && level.keypointIds == keypointIds && sameMask(level.segmImg, segmImg);
+}
+
+/**
+ * The nested fill of several thresholds gives the components of floodFill called for each of them
+ */
+static bool testNestedFill(cv::Mat& img)
+{
+	KeypointIndex keypointIndex;
+	int kpId = 0;
+	for( int y = 0; y < img.rows; y += 3 )
+	{
+		for( int x = 0; x < img.cols; x += 5 )
+			keypointIndex.add(x, y, kpId++, true);
+	}
+	keypointIndex.build();
+
+	const long thresholdSets[][3] = { {12, 25, 40}, {40, 6, 20}, {-12, -25, -40}, {-30, -30, -8} };
+	const int maxSize = 2000;
+	const int minCompSize = 12;
+	std::vector<CvFFillSegment> buffer;
+	std::vector<FloodFillLevel> levels;
+	cv::Mat segmMap = cv::Mat::zeros(img.rows, img.cols, CV_8UC1);
+	int checked = 0;
+	for( size_t t = 0; t < sizeof(thresholdSets) / sizeof(thresholdSets[0]); t++ )
+	{
+		std::vector<long> thresholds(thresholdSets[t], thresholdSets[t] + 3);
+		for( int y = 4; y < img.rows; y += 17 )
+		{
+			for( int x = 3; x < img.cols; x += 13 )
+			{
+				cv::Mat idImage(img.rows, img.cols, CV_32SC1, cv::Scalar(-1));
+				int compCounter = 0;
+				floodFillLevels(buffer, idImage, img, cv::Point(x, y), 0, compCounter, thresholds, maxSize, minCompSize, segmMap, keypointIndex, NULL, levels);
+				if( compCounter != (int) thresholds.size() )
+				{
+					std::cerr << "The nested fill ids: " << compCounter << std::endl;
+					return false;
+				}
+				for( size_t k = 0; k < thresholds.size(); k++ )
+				{
+					cv::Mat singleId(img.rows, img.cols, CV_32SC1, cv::Scalar(-1));
+					int singleCounter = 0;
+					cv::Mat segmImg;
+					cv::Rect rect;
+					int area = 0;
+					std::vector<int> keypointIds;
+					int compNo = floodFill(buffer, singleId, img, cv::Point(x, y), 0, 1.0, singleCounter, thresholds[k], maxSize, minCompSize,
+							segmImg, segmMap, rect, area, keypointIndex, keypointIds, NULL, NULL, true, false);
+					if( !sameLevel(levels[k], compNo, rect, area, segmImg, keypointIds) )
+					{
+						std::cerr << "The nested fill of " << thresholds[k] << " at " << x << ", " << y << " differs: "
+								<< levels[k].compNo << " " << levels[k].rect << " area " << levels[k].area << " nested, "
+								<< compNo << " " << rect << " area " << area << " single" << std::endl;
+						return false;
+					}
+					if( compNo >= 0 )
+						checked++;
+				}
+			}
+		}
+	}
+	if( checked == 0 )
+	{
+		std::cerr << "No nested fill component checked" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * The speculative parallel seed segmentation gives the candidates of the serial one
+ */
+static bool testParallelSegmentation(cv::Ptr<FTPyr> ftDetector, cv::Mat& img, const std::vector<FastKeyPoint>& keypoints,
+		std::unordered_multimap<int, std::pair<int, int> >& keypointsPixels, const std::vector<SegmentOption>& segmentOptions)
+{
+	cv::Ptr<CharClassifier> charClassifier = cv::Ptr<CharClassifier> (new CvBoostCharClassifier(FT_MODEL_FILE));
+	cv::Ptr<PyramidSegmenter> serial = cv::Ptr<PyramidSegmenter> (new PyramidSegmenter(ftDetector, charClassifier));
+	cv::Ptr<PyramidSegmenter> parallel = cv::Ptr<PyramidSegmenter> (new PyramidSegmenter(ftDetector, charClassifier));
+	serial->setSegmentOptions(segmentOptions);
+	parallel->setSegmentOptions(segmentOptions);
+	parallel->parallelSegmentation = true;
+
+	std::vector<LetterCandidate>& serialCandidates = segment(*serial, img, keypoints, keypointsPixels);
+	std::vector<LetterCandidate>& parallelCandidates = segment(*parallel, img, keypoints, keypointsPixels);
+	if( serialCandidates.empty() )
+	{
+		std::cerr << "No letter candidates segmented" << std::endl;
+		return false;
+	}
+	return sameCandidates(serialCandidates, parallelCandidates);
+}
+
+int main(int argc, char **argv)
+{
+	cv::Mat img = makeTextImage();
+	cv::Ptr<FTPyr> ftDetector = cv::Ptr<FTPyr> (new FTPyr(3000, 1.6f, -1, 12, 3, 9, 11, false, false, false));
+	std::vector<FastKeyPoint> keypoints;
+	std::unordered_multimap<int, std::pair<int, int> > keypointsPixels;
+	ftDetector->detect(img, keypoints, keypointsPixels);
+
+	bool valid = true;
+	std::vector<SegmentOption> segmentOptions(1, SegmentOption(0, 1.0));
+	if( !testParallelSegmentation(ftDetector, img, keypoints, keypointsPixels, segmentOptions) )
+	{
+		std::cerr << "Parallel segmentation: failed" << std::endl;
+		valid = false;
+	}
+	if( !testNestedFill(img) )
+	{
+		std::cerr << "Nested fill: failed" << std::endl;
+		valid = false;
+	}
+	//the intensity fill options are segmented by the nested fill
+	segmentOptions.push_back(SegmentOption(0, 0.5));
+	if( !testParallelSegmentation(ftDetector, img, keypoints, keypointsPixels, segmentOptions) )
+	{
+		std::cerr << "Parallel segmentation of the nested options: failed" << std::endl;
+		valid = false;
+	}
+	return valid ? 0 : 1;
+}
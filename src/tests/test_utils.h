@@ -0,0 +1,36 @@
+/*
+ * test_utils.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: Michal.Busta at gmail.com
+ */
+#ifndef TESTS_TEST_UTILS_H_
+#define TESTS_TEST_UTILS_H_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#ifndef FT_MODEL_FILE
+#define FT_MODEL_FILE "cvBoostChar.xml"
+#endif
+
+namespace cmp
+{
+
+/**
+ * @return the gray image of the dark and the light text of several sizes
+ */
+inline cv::Mat makeTextImage()
+{
+	cv::Mat img(480, 640, CV_8UC1, cv::Scalar(200));
+	cv::putText(img, "FASText scene text", cv::Point(20, 80), cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(20), 3);
+	cv::putText(img, "Parallel 0123456789", cv::Point(40, 200), cv::FONT_HERSHEY_DUPLEX, 1.0, cv::Scalar(30), 2);
+	cv::putText(img, "small letters of the line", cv::Point(60, 290), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(10), 1);
+	cv::rectangle(img, cv::Rect(300, 330, 320, 120), cv::Scalar(60), -1);
+	cv::putText(img, "INVERSE", cv::Point(320, 410), cv::FONT_HERSHEY_SIMPLEX, 1.8, cv::Scalar(240), 4);
+	return img;
+}
+
+} /* namespace cmp */
+
+#endif /* TESTS_TEST_UTILS_H_ */